@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: 2021 Chris Roberts
+
+#ifndef _HAVOCOPTIONS_H_
+#define _HAVOCOPTIONS_H_
+
+
+#include "popt/popt.h"
+
+#include <cstddef>
+
+
+// Shared by the application and HelpGenerator, which renders the help text
+// of optionsTable at build time (see PrerenderedHelp.h).
+
+static const float kInitialArgVal = -99999.0;
+
+inline float gAdjustArg = 0.0;
+inline float gVolumeArg = kInitialArgVal;
+inline int gToggleArg = 0;
+inline int gMuteArg = 0;
+inline int gUnMuteArg = 0;
+inline float gNotifyArg = kInitialArgVal;
+
+inline constexpr struct poptOption optionsTable[] = {
+	{"adjust",	'a', POPT_ARG_FLOAT,	&gAdjustArg,	0, "Increase/decrease volume by X dB",	"[1,-2.5,-4,9.5,...]"},
+	{"volume",	'v', POPT_ARG_FLOAT,	&gVolumeArg,	0, "Set absolute volume dB level",		"[-60,-20.5,0,18,...]"},
+	{"toggle",	't', POPT_ARG_NONE,		&gToggleArg,	0, "Toggle mute on/off",				NULL},
+	{"mute",	'm', POPT_ARG_NONE,		&gMuteArg,		0, "Set mute on",						NULL},
+	{"unmute",	'u', POPT_ARG_NONE,		&gUnMuteArg,	0, "Set mute off",						NULL},
+	{"notify",	'n', POPT_ARG_FLOAT | POPT_ARGFLAG_OPTIONAL,	&gNotifyArg,	0, "Show system notification and specify optional timeout (default: 1.5 seconds)",	"1,1.5,3,..."},
+	POPT_AUTOHELP
+	POPT_TABLEEND
+};
+
+#endif	// _HAVOCOPTIONS_H_
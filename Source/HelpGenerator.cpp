@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: MIT
+
+// Build tool: renders the help and usage text of optionsTable for common
+// terminal widths into a header, so that "havoc --help" only has to pick the
+// text for its width instead of rendering it.
+//
+// usage: HelpGenerator <program name> <output header>
+
+
+#include "HavocOptions.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+
+// Widths popt renders for: 79 when not a terminal or up to 80 columns wide,
+// one less than the terminal width otherwise.
+static const int kWidths[] = { 79, 99, 119, 131, 159, 199 };
+
+
+static std::string
+Escape(const char* text)
+{
+	std::string escaped = "\"";
+	for (const unsigned char* s = (const unsigned char*)text; *s != '\0'; s++) {
+		if (*s == '\n' && s[1] != '\0') {
+			// one source line per output line
+			escaped += "\\n\"\n\t\"";
+		} else if (*s == '\n') {
+			escaped += "\\n";
+		} else if (*s == '"' || *s == '\\') {
+			escaped += '\\';
+			escaped += *s;
+		} else if (*s < ' ' || *s >= 0x7f) {
+			char octal[8];
+			snprintf(octal, sizeof(octal), "\\%03o", *s);
+			escaped += octal;
+		} else
+			escaped += *s;
+	}
+	escaped += "\"";
+	return escaped;
+}
+
+
+// Returns the index of text in strings, adding it if needed.
+static size_t
+Intern(std::vector<std::string>& strings, const char* text)
+{
+	for (size_t i = 0; i < strings.size(); i++) {
+		if (strings[i] == text)
+			return i;
+	}
+	strings.push_back(text);
+	return strings.size() - 1;
+}
+
+
+int
+main(int argc, char** argv)
+{
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s <program name> <output header>\n", argv[0]);
+		return 1;
+	}
+
+	const char* name = argv[1];
+	const char* contextArgv[] = { name, NULL };
+	poptContext context = poptGetContext(name, 1, contextArgv, optionsTable, 0);
+	if (context == NULL)
+		return 1;
+
+	std::vector<std::string> strings;
+	std::vector<size_t> help;
+	std::vector<size_t> usage;
+	for (int width : kWidths) {
+		char* helpText = poptHelpString(context, width);
+		char* usageText = poptUsageString(context, width);
+		if (helpText == NULL || usageText == NULL) {
+			fprintf(stderr, "%s: can't render help text\n", argv[0]);
+			return 1;
+		}
+		help.push_back(Intern(strings, helpText));
+		usage.push_back(Intern(strings, usageText));
+		free(helpText);
+		free(usageText);
+	}
+	poptFreeContext(context);
+
+	FILE* file = fopen(argv[2], "w");
+	if (file == NULL) {
+		perror(argv[2]);
+		return 1;
+	}
+
+	fprintf(file, "// Generated by HelpGenerator from HavocOptions.h, do not edit.\n\n"
+		"#ifndef _PRERENDEREDHELP_H_\n#define _PRERENDEREDHELP_H_\n\n\n");
+	for (size_t i = 0; i < strings.size(); i++) {
+		fprintf(file, "static const char kPrerenderedText%zu[] =\n\t%s;\n\n", i,
+			Escape(strings[i].c_str()).c_str());
+	}
+	fprintf(file, "static const struct poptPrerendered kPrerenderedHelp[] = {\n");
+	for (size_t i = 0; i < help.size(); i++) {
+		fprintf(file, "\t{ %s, %d, kPrerenderedText%zu, kPrerenderedText%zu },\n",
+			Escape(name).c_str(), kWidths[i], help[i], usage[i]);
+	}
+	fprintf(file, "\t{ NULL, 0, NULL, NULL }\n};\n\n#endif\t// _PRERENDEREDHELP_H_\n");
+
+	if (fclose(file) != 0) {
+		perror(argv[2]);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: MIT
+
+#ifndef _LOOKUP3_H_
+#define _LOOKUP3_H_
+
+
+#include <cstddef>
+#include <cstdint>
+
+
+/*!	constexpr port of jlu32l() from popt/lookup3.c (Bob Jenkins' lookup3
+	hashlittle()), for hashing option names at compile time.
+
+	Hash(key, length, seed) is bit-identical to jlu32l(seed, key, length)
+	on every host, so hashes computed at compile time can be compared with
+	hashes popt computes at run time. The "name"_jlu3 literal is the hash
+	with seed 0, which allows switching on the hash of an argument:
+
+		switch (Lookup3::Hash(arg)) {
+			case "mute"_jlu3:
+				...
+		}
+
+	where colliding names fail to compile as duplicate case values.
+*/
+namespace Lookup3 {
+
+
+constexpr uint32_t
+Rotate(uint32_t x, int bits)
+{
+	return (x << bits) | (x >> (32 - bits));
+}
+
+
+// _JLU3_MIX
+constexpr void
+Mix(uint32_t& a, uint32_t& b, uint32_t& c)
+{
+	a -= c;  a ^= Rotate(c, 4);  c += b;
+	b -= a;  b ^= Rotate(a, 6);  a += c;
+	c -= b;  c ^= Rotate(b, 8);  b += a;
+	a -= c;  a ^= Rotate(c, 16); c += b;
+	b -= a;  b ^= Rotate(a, 19); a += c;
+	c -= b;  c ^= Rotate(b, 4);  b += a;
+}
+
+
+// _JLU3_FINAL
+constexpr void
+Final(uint32_t& a, uint32_t& b, uint32_t& c)
+{
+	c ^= b; c -= Rotate(b, 14);
+	a ^= c; a -= Rotate(c, 11);
+	b ^= a; b -= Rotate(a, 25);
+	c ^= b; c -= Rotate(b, 16);
+	a ^= c; a -= Rotate(c, 4);
+	b ^= a; b -= Rotate(a, 14);
+	c ^= b; c -= Rotate(b, 24);
+}
+
+
+// Up to 4 key bytes as a little-endian word.
+constexpr uint32_t
+Word(const char* key, size_t length)
+{
+	uint32_t word = 0;
+	for (size_t i = 0; i < length && i < 4; i++)
+		word |= static_cast<uint32_t>(static_cast<uint8_t>(key[i])) << (8 * i);
+	return word;
+}
+
+
+constexpr uint32_t
+Hash(const char* key, size_t length, uint32_t seed = 0)
+{
+	uint32_t a = 0xdeadbeef + static_cast<uint32_t>(length) + seed;
+	uint32_t b = a;
+	uint32_t c = a;
+
+	if (key == nullptr || length == 0)
+		return c;
+
+	while (length > 12) {
+		a += Word(key, 4);
+		b += Word(key + 4, 4);
+		c += Word(key + 8, 4);
+		Mix(a, b, c);
+		length -= 12;
+		key += 12;
+	}
+
+	// the last block, zero padded
+	a += Word(key, length);
+	if (length > 4)
+		b += Word(key + 4, length - 4);
+	if (length > 8)
+		c += Word(key + 8, length - 8);
+	Final(a, b, c);
+	return c;
+}
+
+
+constexpr uint32_t
+Hash(const char* key)
+{
+	size_t length = 0;
+	if (key != nullptr) {
+		while (key[length] != '\0')
+			length++;
+	}
+	return Hash(key, length);
+}
+
+
+// Known answers of hashlittle()
+static_assert(Hash("", 0, 0) == 0xdeadbeef,
+	"Lookup3::Hash() differs from hashlittle()");
+static_assert(Hash("", 0, 0xdeadbeef) == 0xbd5b7dde,
+	"Lookup3::Hash() differs from hashlittle()");
+static_assert(Hash("Four score and seven years ago", 30, 0) == 0x17770551,
+	"Lookup3::Hash() differs from hashlittle()");
+static_assert(Hash("Four score and seven years ago", 30, 1) == 0xcd628161,
+	"Lookup3::Hash() differs from hashlittle()");
+
+
+}	// namespace Lookup3
+
+
+constexpr uint32_t
+operator""_jlu3(const char* key, size_t length)
+{
+	return Lookup3::Hash(key, length);
+}
+
+
+#endif	// _LOOKUP3_H_
@@ -3,6 +3,9 @@
 
 
 #include "popt/system.h"
+#include "HavocOptions.h"
+#include "OptionParser.h"
+#include "PrerenderedHelp.h"
 #include "VolumeControl.h"
 
 #include <Application.h>
@@ -23,27 +26,6 @@
 #endif
 
 
-static const float kInitialArgVal = -99999.0;
-
-float gAdjustArg = 0.0;
-float gVolumeArg = kInitialArgVal;
-int gToggleArg = 0;
-int gMuteArg = 0;
-int gUnMuteArg = 0;
-float gNotifyArg = kInitialArgVal;
-
-const struct poptOption optionsTable[] = {
-	{"adjust",	'a', POPT_ARG_FLOAT,	&gAdjustArg,	0, "Increase/decrease volume by X dB",	"[1,-2.5,-4,9.5,...]"},
-	{"volume",	'v', POPT_ARG_FLOAT,	&gVolumeArg,	0, "Set absolute volume dB level",		"[-60,-20.5,0,18,...]"},
-	{"toggle",	't', POPT_ARG_NONE,		&gToggleArg,	0, "Toggle mute on/off",				NULL},
-	{"mute",	'm', POPT_ARG_NONE,		&gMuteArg,		0, "Set mute on",						NULL},
-	{"unmute",	'u', POPT_ARG_NONE,		&gUnMuteArg,	0, "Set mute off",						NULL},
-	{"notify",	'n', POPT_ARG_FLOAT | POPT_ARGFLAG_OPTIONAL,	&gNotifyArg,	0, "Show system notification and specify optional timeout (default: 1.5 seconds)",	"1,1.5,3,..."},
-	POPT_AUTOHELP
-	POPT_TABLEEND
-};
-
-
 class MixerApp : public BApplication {
 public:
 	MixerApp()
@@ -64,22 +46,7 @@ public:
 	virtual void
 	ArgvReceived(int32 argc, char** argv)
 	{
-		poptContext optionContext = poptGetContext("VolumeControl", argc, const_cast<const char**>(argv), optionsTable, 0);
-
-		int rc = poptGetNextOpt(optionContext);
-		if (rc < -1) {
-			std::cerr << poptBadOption(optionContext, 0) << " : " << poptStrerror(rc) << std::endl;
-			poptPrintHelp(optionContext, stderr, 0);
-			poptFreeContext(optionContext);
-			Quit();
-			return;
-		}
-
-		const char* extraArg = poptPeekArg(optionContext);
-		if (extraArg != NULL) {
-			std::cerr << extraArg << " : unknown extra argument" << std::endl;
-			poptPrintHelp(optionContext, stderr, 0);
-			poptFreeContext(optionContext);
+		if (!_ParseArguments(argc, argv)) {
 			Quit();
 			return;
 		}
@@ -92,10 +59,8 @@ public:
 				fNotificationTimeout = gNotifyArg;
 		}
 
-		if (fVolume->InitCheck() != B_OK) {
-			poptFreeContext(optionContext);
+		if (fVolume->InitCheck() != B_OK)
 			return;
-		}
 
 		// don't allow multiple mute operations at the same time
 		if (gToggleArg != 0) {
@@ -122,8 +87,6 @@ public:
 			fVolume->SetVolume(gVolumeArg);
 			fArgReceived = true;
 		}
-
-		poptFreeContext(optionContext);
 	}
 
 
@@ -186,6 +149,37 @@ private:
 	VolumeControl*	fVolume;
 
 
+	bool
+	_ParseArguments(int32 argc, char** argv)
+	{
+		// plain option lists are parsed without setting up a popt context
+		if (OptionParser<optionsTable>::Parse(argc, argv))
+			return true;
+
+		poptContext optionContext = poptGetContext("VolumeControl", argc, const_cast<const char**>(argv), optionsTable, 0);
+		poptSetPrerendered(optionContext, kPrerenderedHelp);
+
+		int rc = poptGetNextOpt(optionContext);
+		if (rc < -1) {
+			std::cerr << poptBadOption(optionContext, 0) << " : " << poptStrerror(rc) << std::endl;
+			poptPrintHelp(optionContext, stderr, 0);
+			poptFreeContext(optionContext);
+			return false;
+		}
+
+		const char* extraArg = poptPeekArg(optionContext);
+		if (extraArg != NULL) {
+			std::cerr << extraArg << " : unknown extra argument" << std::endl;
+			poptPrintHelp(optionContext, stderr, 0);
+			poptFreeContext(optionContext);
+			return false;
+		}
+
+		poptFreeContext(optionContext);
+		return true;
+	}
+
+
 	BBitmap*
 	_LoadResourceBitmap(const char* name, int32 size)
 	{
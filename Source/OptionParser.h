@@ -0,0 +1,415 @@
+// SPDX-License-Identifier: MIT
+
+#ifndef _OPTIONPARSER_H_
+#define _OPTIONPARSER_H_
+
+
+#include "Lookup3.h"
+#include "popt/popt.h"
+
+#include <array>
+#include <cerrno>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <type_traits>
+#include <utility>
+
+
+/*!	Compile-time specialized front end for a constexpr popt option table.
+
+	Plain options of the table (no callback, no return value, no logical
+	operation flags; POPT_ARG_NONE, _INT, _LONG, _FLOAT or _DOUBLE) are
+	resolved at compile time into a perfect hash over their long names
+	(lookup3, see Lookup3.h), a direct map over their short names and a
+	store function typed after the target variable.
+
+	Parse() accepts "--name", "--name=value", "--name value", "-n" and
+	"-n value" for those options. It parses everything before storing
+	anything: on any other input (help, unknown options, clustered short
+	options, leftovers, bad numbers, ...) it returns false with all target
+	variables untouched, and the caller is expected to hand the same
+	arguments to popt, which then reports or handles them as before.
+
+	Only use it for contexts without aliases or execs.
+*/
+template<const auto& Table>
+class OptionParser {
+public:
+	static	bool				Parse(int argc, const char* const* argv);
+
+private:
+	union Value {
+		long	integer;
+		double	real;
+	};
+
+	typedef bool				(*ConvertFunction)(const char* text,
+									Value& value);
+	typedef void				(*StoreFunction)(const Value& value);
+
+	struct Handler {
+		ConvertFunction			convert;
+		StoreFunction			store;
+		bool					optional;
+	};
+
+	static constexpr size_t		kCount = std::extent_v<
+									std::remove_reference_t<decltype(Table)>>;
+	static constexpr unsigned	kSupportedFlags = POPT_ARG_MASK
+									| POPT_GROUP_MASK | POPT_ARGFLAG_ONEDASH
+									| POPT_ARGFLAG_DOC_HIDDEN
+									| POPT_ARGFLAG_OPTIONAL
+									| POPT_ARGFLAG_SHOW_DEFAULT;
+
+	static constexpr unsigned
+	_Type(size_t index)
+	{
+		return Table[index].argInfo & POPT_ARG_MASK;
+	}
+
+	static constexpr bool
+	_IsEligible(size_t index)
+	{
+		for (size_t i = 0; i < kCount; i++) {
+			// a table callback wants to see every option
+			if (_Type(i) == POPT_ARG_CALLBACK)
+				return false;
+			// popt searches an included table before the entries after it
+			if (i < index && _Type(i) == POPT_ARG_INCLUDE_TABLE)
+				return false;
+		}
+
+		const struct poptOption& option = Table[index];
+		if (option.arg == nullptr || option.val != 0
+			|| (option.argInfo & ~kSupportedFlags) != 0)
+			return false;
+
+		switch (_Type(index)) {
+			case POPT_ARG_NONE:
+			case POPT_ARG_INT:
+			case POPT_ARG_LONG:
+			case POPT_ARG_FLOAT:
+			case POPT_ARG_DOUBLE:
+				return true;
+		}
+		return false;
+	}
+
+	static constexpr size_t
+	_Length(const char* name)
+	{
+		size_t length = 0;
+		while (name[length] != '\0')
+			length++;
+		return length;
+	}
+
+	static constexpr bool
+	_Equals(const char* name, size_t length, const char* other)
+	{
+		for (size_t i = 0; i < length; i++) {
+			if (other[i] != name[i])
+				return false;
+		}
+		return other[length] == '\0';
+	}
+
+	static constexpr size_t
+	_SlotCount()
+	{
+		size_t count = 4;
+		while (count < 2 * kCount)
+			count *= 2;
+		return count;
+	}
+
+	static constexpr size_t		kSlots = _SlotCount();
+
+	static constexpr bool
+	_HasLongName(size_t index)
+	{
+		return _IsEligible(index) && Table[index].longName != nullptr;
+	}
+
+	static constexpr bool
+	_HasShortName(size_t index)
+	{
+		return _IsEligible(index)
+			&& Table[index].shortName > ' ' && Table[index].shortName <= '~';
+	}
+
+	static constexpr bool
+	_HasUniqueNames()
+	{
+		for (size_t i = 0; i < kCount; i++) {
+			for (size_t j = i + 1; j < kCount; j++) {
+				if (_HasLongName(i) && _HasLongName(j)
+					&& _Equals(Table[i].longName,
+						_Length(Table[i].longName), Table[j].longName))
+					return false;
+				if (_HasShortName(i) && _HasShortName(j)
+					&& Table[i].shortName == Table[j].shortName)
+					return false;
+			}
+		}
+		return true;
+	}
+
+	static constexpr uint32_t
+	_FindSeed()
+	{
+		// there is none, don't spend the constexpr budget looking
+		if (!_HasUniqueNames())
+			return UINT32_MAX;
+
+		for (uint32_t seed = 0; seed < 0x10000; seed++) {
+			std::array<bool, kSlots> used{};
+			bool collision = false;
+			for (size_t i = 0; i < kCount && !collision; i++) {
+				if (!_HasLongName(i))
+					continue;
+
+				const char* name = Table[i].longName;
+				size_t slot = Lookup3::Hash(name, _Length(name), seed)
+					& (kSlots - 1);
+				collision = used[slot];
+				used[slot] = true;
+			}
+			if (!collision)
+				return seed;
+		}
+		return UINT32_MAX;
+	}
+
+	static constexpr uint32_t	kSeed = _FindSeed();
+
+	static_assert(_HasUniqueNames(), "duplicate option names in table");
+	static_assert(kSeed != UINT32_MAX || !_HasUniqueNames(),
+		"no perfect hash for option names");
+
+	static constexpr std::array<int16_t, kSlots>
+	_MakeLongMap()
+	{
+		std::array<int16_t, kSlots> map{};
+		for (size_t slot = 0; slot < kSlots; slot++)
+			map[slot] = -1;
+		for (size_t i = 0; i < kCount; i++) {
+			if (!_HasLongName(i))
+				continue;
+
+			const char* name = Table[i].longName;
+			map[Lookup3::Hash(name, _Length(name), kSeed) & (kSlots - 1)] = i;
+		}
+		return map;
+	}
+
+	static constexpr std::array<uint32_t, kSlots>
+	_MakeLongHashes()
+	{
+		// the full hash of the name in each slot, to reject other names
+		// without comparing them
+		std::array<uint32_t, kSlots> hashes{};
+		for (size_t i = 0; i < kCount; i++) {
+			if (!_HasLongName(i))
+				continue;
+
+			const char* name = Table[i].longName;
+			uint32_t hash = Lookup3::Hash(name, _Length(name), kSeed);
+			hashes[hash & (kSlots - 1)] = hash;
+		}
+		return hashes;
+	}
+
+	static constexpr std::array<int16_t, 128>
+	_MakeShortMap()
+	{
+		std::array<int16_t, 128> map{};
+		for (size_t c = 0; c < 128; c++)
+			map[c] = -1;
+		for (size_t i = 0; i < kCount; i++) {
+			// popt tries "-x" as a one dash long option first
+			if (_HasShortName(i) && !_IsShadowed(Table[i].shortName))
+				map[static_cast<uint8_t>(Table[i].shortName)] = i;
+		}
+		return map;
+	}
+
+	static constexpr bool
+	_IsShadowed(char shortName)
+	{
+		for (size_t i = 0; i < kCount; i++) {
+			if (Table[i].longName != nullptr && Table[i].longName[0] == shortName
+				&& Table[i].longName[1] == '\0')
+				return true;
+		}
+		return false;
+	}
+
+	static constexpr std::array<int16_t, kSlots>	kLongMap = _MakeLongMap();
+	static constexpr std::array<uint32_t, kSlots>	kLongHashes
+		= _MakeLongHashes();
+	static constexpr std::array<int16_t, 128>		kShortMap = _MakeShortMap();
+
+	static int
+	_FindLong(const char* name, size_t length)
+	{
+		uint32_t hash = Lookup3::Hash(name, length, kSeed);
+		int index = kLongMap[hash & (kSlots - 1)];
+		if (index < 0 || kLongHashes[hash & (kSlots - 1)] != hash
+			|| !_Equals(name, length, Table[index].longName))
+			return -1;
+		return index;
+	}
+
+	static int
+	_FindShort(char shortName)
+	{
+		if (shortName <= ' ' || shortName > '~')
+			return -1;
+		return kShortMap[static_cast<uint8_t>(shortName)];
+	}
+
+	template<size_t Index>
+	static bool
+	_Convert(const char* text, Value& value)
+	{
+		constexpr unsigned type = _Type(Index);
+
+		// popt reads a missing optional argument as 0, and expands "!#:+"
+		if (text == nullptr) {
+			if constexpr (type == POPT_ARG_FLOAT || type == POPT_ARG_DOUBLE)
+				value.real = 0.0;
+			else
+				value.integer = 0;
+			return true;
+		}
+		for (const char* s = text; *s != '\0'; s++) {
+			if (*s == '!')
+				return false;
+		}
+		if (*text == '\0')
+			return false;
+
+		char* end = nullptr;
+		int savedErrno = errno;
+		errno = 0;
+		if constexpr (type == POPT_ARG_FLOAT || type == POPT_ARG_DOUBLE)
+			value.real = strtod(text, &end);
+		else
+			value.integer = strtol(text, &end, 0);
+		bool valid = errno == 0 && *end == '\0';
+		errno = savedErrno;
+		if (!valid)
+			return false;
+
+		if constexpr (type == POPT_ARG_FLOAT)
+			return std::fabs(value.real) <= FLT_MAX;
+		if constexpr (type == POPT_ARG_INT)
+			return value.integer >= INT_MIN && value.integer <= INT_MAX;
+		return true;
+	}
+
+	template<size_t Index>
+	static void
+	_Store(const Value& value)
+	{
+		constexpr unsigned type = _Type(Index);
+		void* target = Table[Index].arg;
+
+		if constexpr (type == POPT_ARG_NONE)
+			*static_cast<int*>(target) = 1;
+		else if constexpr (type == POPT_ARG_INT)
+			*static_cast<int*>(target) = static_cast<int>(value.integer);
+		else if constexpr (type == POPT_ARG_LONG)
+			*static_cast<long*>(target) = value.integer;
+		else if constexpr (type == POPT_ARG_FLOAT)
+			*static_cast<float*>(target) = static_cast<float>(value.real);
+		else if constexpr (type == POPT_ARG_DOUBLE)
+			*static_cast<double*>(target) = value.real;
+	}
+
+	template<size_t Index>
+	static constexpr Handler
+	_MakeHandler()
+	{
+		if (!_IsEligible(Index))
+			return Handler{ nullptr, nullptr, false };
+		return Handler{ _Type(Index) == POPT_ARG_NONE
+				? nullptr : &_Convert<Index>, &_Store<Index>,
+			(Table[Index].argInfo & POPT_ARGFLAG_OPTIONAL) != 0 };
+	}
+
+	template<size_t... Index>
+	static constexpr std::array<Handler, kCount>
+	_MakeHandlers(std::index_sequence<Index...>)
+	{
+		return {{ _MakeHandler<Index>()... }};
+	}
+
+	static constexpr std::array<Handler, kCount>	kHandlers
+		= _MakeHandlers(std::make_index_sequence<kCount>());
+};
+
+
+template<const auto& Table>
+bool
+OptionParser<Table>::Parse(int argc, const char* const* argv)
+{
+	Value values[kCount];
+	bool seen[kCount] = {};
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		if (arg == nullptr || arg[0] != '-' || arg[1] == '\0')
+			return false;
+
+		const char* text = nullptr;
+		int index;
+		if (arg[1] == '-') {
+			const char* name = arg + 2;
+			const char* end = name;
+			while (*end != '\0' && *end != '=')
+				end++;
+			if (end == name)
+				return false;
+			if (*end == '=')
+				text = end + 1;
+			index = _FindLong(name, end - name);
+		} else {
+			if (arg[2] != '\0')
+				return false;
+			index = _FindShort(arg[1]);
+		}
+		if (index < 0)
+			return false;
+
+		const Handler& handler = kHandlers[index];
+		if (handler.convert == nullptr) {
+			if (text != nullptr)
+				return false;
+		} else {
+			if (text == nullptr && i + 1 < argc
+				&& !(handler.optional && argv[i + 1][0] == '-'))
+				text = argv[++i];
+			else if (text == nullptr && !handler.optional)
+				return false;
+			if (!handler.convert(text, values[index]))
+				return false;
+		}
+
+		seen[index] = true;
+	}
+
+	for (size_t index = 0; index < kCount; index++) {
+		if (seen[index])
+			kHandlers[index].store(values[index]);
+	}
+	return true;
+}
+
+
+#endif	// _OPTIONPARSER_H_
@@ -0,0 +1,197 @@
+/** \ingroup popt
+ * \file popt/bench/argv-bench.c
+ * POPT_ARG_ARGV checks and timings: collecting 1000 to 100000 repeated
+ * "--include" args must take linear time, also when poptGetNextOpt()
+ * returns to the application after each, and a vector that the
+ * application replaced (at the same address) must be relearned.
+ * "-c" runs the checks only.
+ */
+
+#include "system.h"
+#include <time.h>
+
+/**
+ * Return a monotonic time stamp.
+ * @return		time in ns
+ */
+static double bench_ns(void)
+	/*@*/
+{
+    struct timespec ts;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/**
+ * Free a vector collected by popt.
+ * @param av		argv array
+ */
+static void argvFree(const char ** av)
+	/*@*/
+{
+    int i;
+
+    if (av != NULL)
+    for (i = 0; av[i] != NULL; i++)
+	free((void *)av[i]);
+    free(av);
+}
+
+/**
+ * Parse n repeated "--include" args.
+ * @param n		no. of args
+ * @param val		option val, non-zero to return after each arg
+ * @retval *nsp		parse time in ns
+ * @return		no. of failures
+ */
+static int parseIncludes(int n, int val, double * nsp)
+	/*@*/
+{
+    const char ** includes = NULL;
+    struct poptOption opts[] = {
+	{ "include", 'I', POPT_ARG_ARGV, &includes, val, NULL, NULL },
+	POPT_TABLEEND
+    };
+    const char ** argv = calloc((size_t)n + 2, sizeof(*argv));
+    char * b = malloc((size_t)n * 32);
+    poptContext con;
+    double t0;
+    int rc = 0;
+    int xx;
+    int i;
+
+    if (argv == NULL || b == NULL)
+	exit(EXIT_FAILURE);
+    argv[0] = "argv-bench";
+    for (i = 0; i < n; i++) {
+	argv[i + 1] = b + 32 * i;
+	(void) snprintf(b + 32 * i, 32, "--include=dir%d", i);
+    }
+
+    t0 = bench_ns();
+    con = poptGetContext(argv[0], n + 1, argv, opts, 0);
+    if (con == NULL)
+	exit(EXIT_FAILURE);
+    while ((xx = poptGetNextOpt(con)) == val && val != 0)
+	{};
+    if (xx != -1)
+	rc++;
+    *nsp = bench_ns() - t0;
+
+    for (i = 0; includes != NULL && includes[i] != NULL; i++) {
+	if (strcmp(includes[i], argv[i + 1] + sizeof("--include=") - 1))
+	    break;
+    }
+    if (i != n)
+	rc++;
+
+    (void) poptFreeContext(con);
+    argvFree(includes);
+    free(b);
+    free(argv);
+    return rc;
+}
+
+/**
+ * Check that a vector the application freed, reallocated at the same
+ * address and filled with fewer args, is relearned rather than appended
+ * to at its old length. The application's NULL must land on the arg popt
+ * appended last: stale memory past it isn't checked.
+ * @return		no. of failures
+ */
+static int checkReplaced(void)
+	/*@*/
+{
+    const char ** adds = NULL;
+    struct poptOption opts[] = {
+	{ "add", 'a', POPT_ARG_ARGV, &adds, 'a', NULL, NULL },
+	POPT_TABLEEND
+    };
+    const char * argv[] = { "argv-bench",
+	"--add", "a", "--add", "b", "--add", "c", "--add", "d", NULL };
+    poptContext con = poptGetContext(argv[0], 9, argv, opts, 0);
+    const char ** old;
+    const char * a;
+    const char * b;
+    int rc = 0;
+    int i;
+
+    if (con == NULL)
+	return 1;
+    for (i = 0; i < 3; i++)
+	if (poptGetNextOpt(con) != 'a')
+	    rc++;
+
+    /* Keep the 1st 2 args only, in a vector of the same size. */
+    old = adds;
+    a = adds[0];
+    b = adds[1];
+    free((void *)adds[2]);
+    free(adds);
+    if ((adds = malloc(8 * sizeof(*adds))) == NULL)
+	exit(EXIT_FAILURE);
+    adds[0] = a;
+    adds[1] = b;
+    adds[2] = NULL;
+
+    if (poptGetNextOpt(con) != 'a' || poptGetNextOpt(con) != -1)
+	rc++;
+    if (adds[0] != a || adds[1] != b || adds[2] == NULL || strcmp(adds[2], "d")
+     || adds[3] != NULL)
+    {
+	fprintf(stderr, "replaced POPT_ARG_ARGV vector was appended to at its old length\n");
+	rc++;
+    }
+    if (adds != old && rc == 0)
+	printf("replaced vector check: not at the same address\n");
+
+    (void) poptFreeContext(con);
+    argvFree(adds);
+    return rc;
+}
+
+int main(int argc, const char ** argv)
+{
+    int bench = !(argc > 1 && strcmp(argv[1], "-c") == 0);
+    static const int vals[] = { 0, 'I' };
+    int fails = checkReplaced();
+    int v;
+
+    if (bench)
+	printf("%8s %8s %12s %12s\n", "val", "args", "ms", "ns/arg");
+    for (v = 0; v < (int)(sizeof(vals) / sizeof(vals[0])); v++) {
+	double small = 0.0;
+	double large = 0.0;
+	int n;
+
+	for (n = 1000; n <= 100000; n *= 10) {
+	    double best = 0.0;
+	    int trial;
+
+	    for (trial = 0; trial < 3; trial++) {
+		double t;
+		fails += parseIncludes(n, vals[v], &t);
+		if (trial == 0 || t < best)
+		    best = t;
+	    }
+	    if (n == 1000)
+		small = best / n;
+	    large = best / n;
+	    if (bench)
+		printf("%8d %8d %12.2f %12.1f\n", vals[v], n, best / 1e6, best / n);
+	}
+	/* Quadratic collection costs 100x more per arg at 100000 than 1000. */
+	if (large > 10 * small) {
+	    fprintf(stderr, "POPT_ARG_ARGV collection (val %d) isn't linear: %.1f ns/arg at 100000 args, %.1f at 1000\n",
+		vals[v], large, small);
+	    fails++;
+	}
+    }
+
+    if (fails)
+	printf("%d checks FAILED\n", fails);
+    else
+	printf("all checks passed\n");
+    return (fails ? 1 : 0);
+}
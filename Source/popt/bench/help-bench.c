@@ -0,0 +1,298 @@
+/** \ingroup popt
+ * \file popt/bench/help-bench.c
+ * Help rendering check and timings: poptPrintHelp() and poptPrintUsage()
+ * of generated tables of 16 to 4096 options, with heap allocated help
+ * text as config file aliases have. "-c" runs the check only.
+ */
+
+#include "system.h"
+#include <time.h>
+#if defined(ENABLE_NLS) && defined(HAVE_DCGETTEXT)
+#include <locale.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <libintl.h>
+#endif
+
+#define	BENCH_DOMAIN	"popt-help-bench"
+#define	BENCH_LANGUAGE	"xx"
+
+static const struct poptOption autoHelp[] = {
+    POPT_AUTOHELP
+    POPT_TABLEEND
+};
+
+/**
+ * Return a monotonic time stamp.
+ * @return		time in ns
+ */
+static double bench_ns(void)
+	/*@*/
+{
+    struct timespec ts;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/**
+ * Generate a table of options with heap allocated names and help text.
+ * @param n		no. of options
+ * @param fmt		help text format, of the option index
+ * @return		option table
+ */
+static struct poptOption * tableNew(int n, const char * fmt)
+	/*@*/
+{
+    struct poptOption * opts = calloc((size_t)n + 2, sizeof(*opts));
+    char b[64];
+    int i;
+
+    if (opts == NULL)
+	exit(EXIT_FAILURE);
+    for (i = 0; i < n; i++) {
+	(void) snprintf(b, sizeof(b), "option-%d", i);
+	opts[i].longName = xstrdup(b);
+	opts[i].argInfo = ((i & 1) ? POPT_ARG_INT : POPT_ARG_NONE);
+	(void) snprintf(b, sizeof(b), fmt, i);
+	opts[i].descrip = xstrdup(b);
+	opts[i].argDescrip = ((i & 1) ? "N" : NULL);
+    }
+    opts[n] = autoHelp[0];
+    return opts;
+}
+
+/**
+ * Free a table made by tableNew().
+ * @param opts		option table
+ * @param n		no. of options
+ */
+static void tableFree(struct poptOption * opts, int n)
+	/*@*/
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+	free((void *)opts[i].longName);
+	free((void *)opts[i].descrip);
+    }
+    free(opts);
+}
+
+/**
+ * Render the help of a table into a string.
+ * @param opts		option table
+ * @return		help text (malloc'd)
+ */
+static char * helpText(const struct poptOption * opts)
+	/*@*/
+{
+    const char * argv[] = { "help-bench", NULL };
+    poptContext con = poptGetContext(argv[0], 1, argv, opts, 0);
+    FILE * fp = tmpfile();
+    char * s = NULL;
+    long ns;
+
+    if (con == NULL || fp == NULL)
+	exit(EXIT_FAILURE);
+    poptPrintHelp(con, fp, 0);
+    if ((ns = ftell(fp)) >= 0 && (s = calloc(1, (size_t)ns + 1)) != NULL) {
+	rewind(fp);
+	if (fread(s, 1, (size_t)ns, fp) != (size_t)ns)
+	    s[0] = '\0';
+    }
+    (void) fclose(fp);
+    (void) poptFreeContext(con);
+    return s;
+}
+
+#if defined(ENABLE_NLS) && defined(HAVE_DCGETTEXT)
+/**
+ * Write a message catalog translating one msgid.
+ * @param fn		catalog file name
+ * @param msgid		msgid
+ * @param msgstr	translation
+ * @return		0 on success
+ */
+static int catalogWrite(const char * fn, const char * msgid, const char * msgstr)
+	/*@*/
+{
+    const char * ids[2] = { "", msgid };	/* sorted */
+    const char * strs[2] = { "Content-Type: text/plain; charset=UTF-8\n", msgstr };
+    uint32_t hdr[7] = { 0x950412deU, 0, 2, 28, 28 + 16, 0, 28 + 32 };
+    uint32_t tab[8];
+    uint32_t off = 28 + 32;
+    FILE * fp;
+    int rc = 0;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+	tab[2 * i] = (uint32_t) strlen(ids[i]);
+	tab[2 * i + 1] = off;
+	off += tab[2 * i] + 1;
+    }
+    for (i = 0; i < 2; i++) {
+	tab[4 + 2 * i] = (uint32_t) strlen(strs[i]);
+	tab[4 + 2 * i + 1] = off;
+	off += tab[4 + 2 * i] + 1;
+    }
+    if ((fp = fopen(fn, "wb")) == NULL)
+	return -1;
+    if (fwrite(hdr, sizeof(hdr), 1, fp) != 1
+     || fwrite(tab, sizeof(tab), 1, fp) != 1)
+	rc = -1;
+    for (i = 0; i < 2; i++)
+	if (fwrite(ids[i], strlen(ids[i]) + 1, 1, fp) != 1)
+	    rc = -1;
+    for (i = 0; i < 2; i++)
+	if (fwrite(strs[i], strlen(strs[i]) + 1, 1, fp) != 1)
+	    rc = -1;
+    if (fclose(fp) != 0)
+	rc = -1;
+    return rc;
+}
+
+/**
+ * Check that help text freed and reallocated (likely at the same
+ * addresses) renders as the new text, not as the translation memoized
+ * for the text before it.
+ * @return		no. of failures
+ */
+static int checkHeapHelp(void)
+	/*@*/
+{
+    char dir[] = "/tmp/popt-help-bench.XXXXXX";
+    char lang[sizeof(dir) + sizeof("/" BENCH_LANGUAGE)];
+    char msgs[sizeof(lang) + sizeof("/LC_MESSAGES")];
+    char mo[sizeof(msgs) + sizeof("/" BENCH_DOMAIN ".mo")];
+    int n = 64;
+    struct poptOption * opts;
+    char * s;
+    int rc = 0;
+    int i;
+
+    if (mkdtemp(dir) == NULL)
+	return 1;
+    (void) snprintf(lang, sizeof(lang), "%s/%s", dir, BENCH_LANGUAGE);
+    (void) snprintf(msgs, sizeof(msgs), "%s/LC_MESSAGES", lang);
+    (void) snprintf(mo, sizeof(mo), "%s/%s.mo", msgs, BENCH_DOMAIN);
+    if (mkdir(lang, 0700) || mkdir(msgs, 0700)
+     || catalogWrite(mo, "first help text 063", "translated help text"))
+	rc++;
+    (void) setenv("LANGUAGE", BENCH_LANGUAGE, 1);
+    if (setlocale(LC_ALL, "C.UTF-8") == NULL)
+	(void) setlocale(LC_ALL, "");
+    (void) bindtextdomain(BENCH_DOMAIN, dir);
+    (void) textdomain(BENCH_DOMAIN);
+
+    opts = tableNew(n, "first help text %03d");
+    s = helpText(opts);
+    if (s == NULL || strstr(s, "first help text 062") == NULL)
+	rc++;
+    else if (strstr(s, "translated help text") == NULL)
+	printf("heap help text check skipped: catalog not used\n");
+    else {
+	free(s);
+	for (i = 0; i < n; i++) {
+	    char b[64];
+	    free((void *)opts[i].descrip);
+	    (void) snprintf(b, sizeof(b), "other help text %03d", i);
+	    opts[i].descrip = xstrdup(b);
+	}
+	s = helpText(opts);
+	if (s == NULL || strstr(s, "other help text 063") == NULL
+	 || strstr(s, "translated help text") != NULL)
+	{
+	    fprintf(stderr, "help text of reused heap strings is stale\n");
+	    rc++;
+	}
+    }
+    free(s);
+    tableFree(opts, n);
+
+    (void) unlink(mo);
+    (void) rmdir(msgs);
+    (void) rmdir(lang);
+    (void) rmdir(dir);
+    return rc;
+}
+#else
+/**
+ * Check that heap allocated help text renders.
+ * @return		no. of failures
+ */
+static int checkHeapHelp(void)
+	/*@*/
+{
+    int n = 64;
+    struct poptOption * opts = tableNew(n, "help text %03d");
+    char * s = helpText(opts);
+    int rc = (s == NULL || strstr(s, "help text 063") == NULL);
+
+    free(s);
+    tableFree(opts, n);
+    return rc;
+}
+#endif
+
+/**
+ * Time help and usage rendering of tables of 16 to 4096 options.
+ */
+static void benchHelp(void)
+	/*@*/
+{
+    const char * argv[] = { "help-bench", NULL };
+    FILE * fp = fopen("/dev/null", "w");
+    int n;
+
+    if (fp == NULL)
+	exit(EXIT_FAILURE);
+    printf("%8s %12s %12s %12s %12s\n",
+		"options", "help us", "ns/option", "usage us", "ns/option");
+    for (n = 16; n <= 4096; n *= 4) {
+	struct poptOption * opts = tableNew(n, "Description of option %d");
+	poptContext con = poptGetContext(argv[0], 1, argv, opts, 0);
+	int reps = (65536 / n > 1 ? 65536 / n : 1);
+	double help = 0.0;
+	double usage = 0.0;
+	int trial;
+	int i;
+
+	if (con == NULL)
+	    exit(EXIT_FAILURE);
+	poptPrintHelp(con, fp, 0);	/* warm up */
+	for (trial = 0; trial < 5; trial++) {
+	    double t0 = bench_ns();
+	    double t;
+	    for (i = 0; i < reps; i++)
+		poptPrintHelp(con, fp, 0);
+	    t = (bench_ns() - t0) / reps;
+	    if (trial == 0 || t < help)
+		help = t;
+	    t0 = bench_ns();
+	    for (i = 0; i < reps; i++)
+		poptPrintUsage(con, fp, 0);
+	    t = (bench_ns() - t0) / reps;
+	    if (trial == 0 || t < usage)
+		usage = t;
+	}
+	printf("%8d %12.1f %12.1f %12.1f %12.1f\n", n,
+		help / 1e3, help / n, usage / 1e3, usage / n);
+	(void) poptFreeContext(con);
+	tableFree(opts, n);
+    }
+    (void) fclose(fp);
+}
+
+int main(int argc, const char ** argv)
+{
+    int fails = checkHeapHelp();
+
+    if (fails)
+	printf("%d checks FAILED\n", fails);
+    else
+	printf("all checks passed\n");
+    if (!(argc > 1 && strcmp(argv[1], "-c") == 0))
+	benchHelp();
+    return (fails ? 1 : 0);
+}
@@ -0,0 +1,506 @@
+/** \ingroup popt
+ * \file popt/bench/numeric-check.c
+ * POPT_CONTEXT_C_NUMERIC checks and timings: integer and floating point
+ * args, random and at the edges of the fast paths, must convert as
+ * strtoll(3) and strtod(3) in the C locale do, also when LC_NUMERIC has
+ * another radix. "-c" runs the checks only.
+ */
+
+#include "system.h"
+#include <time.h>
+#include <locale.h>
+#include <stdint.h>
+
+#define	NRANDOM		100000
+#define	MAXARG		64
+#define	MAXSHOWN	10
+
+/** An arg, and its expected conversion. */
+struct numArg_s {
+    char val[MAXARG];
+    int rc;
+    long long ll;
+    double d;
+};
+
+/* Integer args, in bases 8, 10 and 16, at the range and syntax edges. */
+static const char * intEdges[] = {
+    "0", "-0", "+0", "00", "0x0", "0X0", "7", "-7", "010", "-010", "0x1f",
+    "0XaBc", "-0x1F", " 12", "\t\n-12", "12 ", "", " ", "-", "+", "--1",
+    "+-1", "0x", "0X", "-0x", "0xg", "08", "09", "0x1g", "1.0", "1e3",
+    "9223372036854775805", "9223372036854775806", "9223372036854775807",
+    "9223372036854775808", "-9223372036854775807", "-9223372036854775808",
+    "-9223372036854775809", "18446744073709551615", "18446744073709551616",
+    "99999999999999999999999", "99999999999999999999999x",
+    "0777777777777777777776", "0777777777777777777777",
+    "01000000000000000000000", "-01000000000000000000000",
+    "-01000000000000000000001", "01777777777777777777777",
+    "0x7ffffffffffffffe", "0x7fffffffffffffff", "0x8000000000000000",
+    "-0x7fffffffffffffff", "-0x8000000000000000", "-0x8000000000000001",
+    "0xffffffffffffffff", "0x10000000000000000", "0x00000000000000000001",
+};
+
+/* Floating point args at the edges of the fast path, and past them. */
+static const char * dblEdges[] = {
+    "0", "-0", "+0", "0.0", "-0.0", ".5", "5.", ".", "-.", "e5", ".e5",
+    "1e", "1e+", "1e-", "1E5", "1e+05", "1e-05", " 1.5", "1.5 ", "1,5",
+    "1..5", "1.5.", "1e5.", "0x1p-1074", "0x1.fffffffffffffp1023", "inf",
+    "-Infinity", "nan", "NaN(123)",
+    "1e22", "1e23", "-1e22", "1e-22", "1e-23", "123e20", "123e21",
+    "10000000000000000000000", "100000000000000000000000",
+    "0.0000000000000000000001", "0.00000000000000000000001",
+    "9007199254740991", "9007199254740992", "9007199254740993",
+    "9007199254740994", "9007199254740995", "-9007199254740993",
+    "9007199254740992e22", "9007199254740993e22", "9007199254740992e-22",
+    "9007199254740993e-22", "900719925474099.2e1", "0.9007199254740993e16",
+    "9999999999999999999", "9999999999999999999e-22", "99999999999999999999",
+    "1234567890123456789", "12345678901234567890", "1e-320", "4.9e-324",
+    "4.9406564584124654e-324", "2.4703282292062327e-324",
+    "2.4703282292062328e-324", "2.2250738585072011e-308",
+    "2.2250738585072014e-308", "2.225073858507201136057409796709131975934e-308",
+    "1.7976931348623157e308", "1.7976931348623159e308", "1e308", "1e309",
+    "-1e309", "1e-400", "0e999999", "0.000e-999999", "1e999999999999",
+};
+
+static uint64_t rngState = 0x2545f4914f6cdd1dULL;
+
+/**
+ * Return a pseudo random number (xorshift64*, fixed seed).
+ * @return		random number
+ */
+static uint64_t rng(void)
+	/*@modifies rngState @*/
+{
+    rngState ^= rngState >> 12;
+    rngState ^= rngState << 25;
+    rngState ^= rngState >> 27;
+    return rngState * 0x2545f4914f6cdd1dULL;
+}
+
+/**
+ * Return a pseudo random number in [0, n).
+ * @param n		upper bound
+ * @return		random number
+ */
+static unsigned int rngBelow(unsigned int n)
+	/*@modifies rngState @*/
+{
+    return (unsigned int)((rng() >> 32) % n);
+}
+
+/**
+ * Return a monotonic time stamp.
+ * @return		time in ns
+ */
+static double bench_ns(void)
+	/*@*/
+{
+    struct timespec ts;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/**
+ * Append random digits.
+ * @param te		end of the arg so far
+ * @param n		no. of digits
+ * @param base		8, 10 or 16
+ * @return		new end of the arg
+ */
+static char * digitsAppend(char * te, unsigned int n, unsigned int base)
+	/*@modifies rngState @*/
+{
+    static const char xdigits[] = "0123456789abcdefABCDEF";
+
+    while (n-- > 0)
+	*te++ = xdigits[rngBelow(base == 16 ? 22 : base)];
+    *te = '\0';
+    return te;
+}
+
+/**
+ * Generate a random integer arg: optional space and sign, then 1 to 24
+ * digits in base 8, 10 or 16 (so that about half overflow), and now and
+ * then a stray character.
+ * @retval b		arg
+ */
+static void intRandom(char * b)
+	/*@modifies b, rngState @*/
+{
+    static const unsigned int bases[] = { 8, 10, 16 };
+    static const char junk[] = " x8g.e-";
+    unsigned int base = bases[rngBelow(3)];
+    char * te = b;
+
+    if (rngBelow(16) == 0)
+	*te++ = ' ';
+    switch (rngBelow(4)) {
+    case 0:	*te++ = '-';	break;
+    case 1:	*te++ = '+';	break;
+    default:			break;
+    }
+    if (base == 8)
+	*te++ = '0';
+    else if (base == 16) {
+	*te++ = '0';
+	*te++ = (rngBelow(2) ? 'x' : 'X');
+    }
+    /* Leading 1-7 keep the length, and so overflow, in control. */
+    *te++ = "1234567"[rngBelow(7)];
+    te = digitsAppend(te, rngBelow(24), base);
+    if (rngBelow(32) == 0)
+	b[rngBelow((unsigned int)(te - b))] = junk[rngBelow(sizeof(junk) - 1)];
+}
+
+/**
+ * Generate a random floating point arg: decimals of up to 21 digits
+ * with exponents around the fast path limits, mantissas around 2^53,
+ * powers of 10, subnormals and overflows.
+ * @retval b		arg
+ */
+static void dblRandom(char * b)
+	/*@modifies b, rngState @*/
+{
+    char * te = b;
+    int ne;
+
+    if (rngBelow(3) == 0)
+	*te++ = '-';
+    switch (rngBelow(5)) {
+    case 0:	/* decimal, at most 21 digits */
+    {	unsigned int ni = rngBelow(12);
+	te = digitsAppend(te, ni, 10);
+	if (ni == 0 || rngBelow(2)) {
+	    *te++ = '.';
+	    te = digitsAppend(te, rngBelow(10) + (ni == 0), 10);
+	}
+	ne = (int)rngBelow(61) - 30;
+    }	break;
+    case 1:	/* mantissa around 2^53 */
+	te += sprintf(te, "%llu",
+		(1ULL << 53) - 16 + (unsigned long long)rngBelow(33));
+	ne = (int)rngBelow(47) - 23;
+	break;
+    case 2:	/* power of 10 */
+	*te++ = '1';
+	while (te - b < 24 && rngBelow(2))
+	    *te++ = '0';
+	ne = (int)rngBelow(51) - 25;
+	break;
+    case 3:	/* subnormal */
+	te = digitsAppend(te, 1, 10);
+	*te++ = '.';
+	te = digitsAppend(te, rngBelow(20), 10);
+	ne = -300 - (int)rngBelow(30);
+	break;
+    default:	/* anything representable, and past it */
+	te = digitsAppend(te, rngBelow(20) + 1, 10);
+	ne = (int)rngBelow(701) - 350;
+	break;
+    }
+    if (ne != 0 || rngBelow(4) == 0)
+	(void) sprintf(te, "%c%d", (rngBelow(2) ? 'e' : 'E'), ne);
+    else
+	*te = '\0';
+}
+
+/**
+ * Convert an integer arg as strtoll(3) does, with the option range
+ * of POPT_ARG_LONGLONG.
+ * @param a		arg
+ */
+static void intExpect(struct numArg_s * a)
+	/*@modifies a @*/
+{
+    char * end = NULL;
+
+    errno = 0;
+    a->ll = strtoll(a->val, &end, 0);
+    if (end == a->val || *end != '\0')
+	a->rc = POPT_ERROR_BADNUMBER;
+    else if (errno == ERANGE || a->ll == LLONG_MIN || a->ll == LLONG_MAX)
+	a->rc = POPT_ERROR_OVERFLOW;
+    else
+	a->rc = 0;
+}
+
+/**
+ * Convert a floating point arg as strtod(3) does.
+ * @param a		arg
+ */
+static void dblExpect(struct numArg_s * a)
+	/*@modifies a @*/
+{
+    char * end = NULL;
+
+    errno = 0;
+    a->d = strtod(a->val, &end);
+    if (errno == ERANGE)
+	a->rc = POPT_ERROR_OVERFLOW;
+    else if (end == a->val || *end != '\0')
+	a->rc = POPT_ERROR_BADNUMBER;
+    else
+	a->rc = 0;
+}
+
+/**
+ * Parse "--<name>=<val>".
+ * @param name		"ll" or "d"
+ * @param val		arg
+ * @param flags		context flags
+ * @retval *llp		POPT_ARG_LONGLONG value
+ * @retval *dp		POPT_ARG_DOUBLE value
+ * @return		0 on success, POPT_ERROR_* on failure
+ */
+static int parseArg(const char * name, const char * val, unsigned int flags,
+		long long * llp, double * dp)
+	/*@modifies *llp, *dp @*/
+{
+    struct poptOption opts[] = {
+	{ "ll", '\0', POPT_ARG_LONGLONG, NULL, 0, NULL, NULL },
+	{ "d", '\0', POPT_ARG_DOUBLE, NULL, 0, NULL, NULL },
+	POPT_TABLEEND
+    };
+    char b[MAXARG + 8];
+    const char * argv[] = { "numeric-check", b, NULL };
+    poptContext con;
+    int rc;
+
+    opts[0].arg = llp;
+    opts[1].arg = dp;
+    (void) snprintf(b, sizeof(b), "--%s=%s", name, val);
+    con = poptGetContext(argv[0], 2, argv, opts, flags);
+    if (con == NULL)
+	exit(EXIT_FAILURE);
+    rc = poptGetNextOpt(con);
+    (void) poptFreeContext(con);
+    return (rc == -1 ? 0 : rc);
+}
+
+/**
+ * Check C numeric conversions of args against their expected values;
+ * doubles must match bit for bit.
+ * @param what		"integer" or "double"
+ * @param args		args
+ * @param n		no. of args
+ * @param where		locale description
+ * @return		no. of failures
+ */
+static int checkArgs(const char * what, const struct numArg_s * args, int n,
+		const char * where)
+	/*@*/
+{
+    int dbl = (strcmp(what, "double") == 0);
+    int fails = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+	const struct numArg_s * a = args + i;
+	long long ll = 0;
+	double d = 0.0;
+	int rc = parseArg((dbl ? "d" : "ll"), a->val, POPT_CONTEXT_C_NUMERIC,
+		&ll, &d);
+
+	if (rc == a->rc && (rc != 0 || (dbl
+		? memcmp(&d, &a->d, sizeof(d)) == 0 : ll == a->ll)))
+	    continue;
+	if (fails++ < MAXSHOWN) {
+	    if (dbl)
+		fprintf(stderr, "%s \"%s\"%s: rc %d %.17g, expected rc %d %.17g\n",
+			what, a->val, where, rc, d, a->rc, a->d);
+	    else
+		fprintf(stderr, "%s \"%s\"%s: rc %d %lld, expected rc %d %lld\n",
+			what, a->val, where, rc, ll, a->rc, a->ll);
+	}
+    }
+    if (fails > MAXSHOWN)
+	fprintf(stderr, "%s%s: %d more failures\n", what, where, fails - MAXSHOWN);
+    return fails;
+}
+
+/**
+ * Generate a typical floating point arg: up to 6 digits, with a few
+ * decimals or a small exponent, as on command lines.
+ * @retval b		arg
+ */
+static void dblShort(char * b)
+	/*@modifies b, rngState @*/
+{
+    unsigned int m = rngBelow(1000000);
+
+    switch (rngBelow(3)) {
+    case 0:
+	(void) sprintf(b, "%u.%u", m / 1000, m % 1000);
+	break;
+    case 1:
+	(void) sprintf(b, "0.%06u", m);
+	break;
+    default:
+	(void) sprintf(b, "%ue%d", m, (int)rngBelow(21) - 10);
+	break;
+    }
+}
+
+/**
+ * Time conversion of the valid args by strtoll(3)/strtod(3) alone, and
+ * parsing them without and with POPT_CONTEXT_C_NUMERIC, all in one
+ * context so that context setup doesn't swamp the conversions.
+ * @param what		row label
+ * @param dbl		floating point args?
+ * @param args		args
+ * @param n		no. of args
+ */
+static void benchArgs(const char * what, int dbl,
+		const struct numArg_s * args, int n)
+	/*@*/
+{
+    static const unsigned int flags[] = { 0, POPT_CONTEXT_C_NUMERIC };
+    long long ll = 0;
+    double d = 0.0;
+    struct poptOption opts[] = {
+	{ "ll", '\0', POPT_ARG_LONGLONG, NULL, 0, NULL, NULL },
+	{ "d", '\0', POPT_ARG_DOUBLE, NULL, 0, NULL, NULL },
+	POPT_TABLEEND
+    };
+    const char ** argv = calloc((size_t)n + 2, sizeof(*argv));
+    char * b = malloc((size_t)n * (MAXARG + 8));
+    double best[3] = { 0.0, 0.0, 0.0 };
+    int argc = 1;
+    int trial;
+    int f;
+    int i;
+
+    if (argv == NULL || b == NULL)
+	exit(EXIT_FAILURE);
+    opts[0].arg = &ll;
+    opts[1].arg = &d;
+    argv[0] = "numeric-check";
+    for (i = 0; i < n; i++) {
+	if (args[i].rc != 0)
+	    continue;
+	argv[argc] = b + (MAXARG + 8) * i;
+	(void) snprintf(b + (MAXARG + 8) * i, MAXARG + 8, "--%s=%s",
+		(dbl ? "d" : "ll"), args[i].val);
+	argc++;
+    }
+
+    for (trial = 0; trial < 3; trial++)
+    for (f = 0; f < 3; f++) {
+	double t0 = bench_ns();
+	double t;
+
+	if (f == 0) {
+	    for (i = 1; i < argc; i++) {
+		const char * val = strchr(argv[i], '=') + 1;
+		if (dbl)
+		    d += strtod(val, NULL);
+		else
+		    ll += strtoll(val, NULL, 0);
+	    }
+	} else {
+	    poptContext con = poptGetContext(argv[0], argc, argv, opts,
+			flags[f - 1]);
+	    if (con == NULL || poptGetNextOpt(con) != -1)
+		exit(EXIT_FAILURE);
+	    (void) poptFreeContext(con);
+	}
+	t = (bench_ns() - t0) / (argc - 1);
+	if (trial == 0 || t < best[f])
+	    best[f] = t;
+    }
+    printf("%8s %12.1f %12.1f %12.1f\n", what, best[0], best[1], best[2]);
+    free(b);
+    free(argv);
+}
+
+/**
+ * Generate args, and their expected conversions in the C locale.
+ * @param edges		edge case args
+ * @param nedges	no. of edge case args
+ * @param gen		random arg generator
+ * @param expect	conversion
+ * @retval *np		no. of args
+ * @return		args (malloc'd)
+ */
+static struct numArg_s * argsNew(const char ** edges, int nedges,
+		void (*gen) (char * b), void (*expect) (struct numArg_s * a),
+		int * np)
+	/*@modifies rngState, *np @*/
+{
+    int n = nedges + NRANDOM;
+    struct numArg_s * args = calloc((size_t)n, sizeof(*args));
+    int i;
+
+    if (args == NULL)
+	exit(EXIT_FAILURE);
+    for (i = 0; i < n; i++) {
+	if (i < nedges)
+	    (void) snprintf(args[i].val, sizeof(args[i].val), "%s", edges[i]);
+	else
+	    gen(args[i].val);
+	expect(args + i);
+    }
+    *np = n;
+    return args;
+}
+
+int main(int argc, const char ** argv)
+{
+    int bench = !(argc > 1 && strcmp(argv[1], "-c") == 0);
+    static const char * radixLocales[] = {
+	"de_DE.UTF-8", "de_DE", "fr_FR.UTF-8", "fr_FR", "ru_RU.UTF-8",
+    };
+    struct numArg_s * ints;
+    struct numArg_s * dbls;
+    int nints;
+    int ndbls;
+    int fails = 0;
+    size_t i;
+
+    (void) setlocale(LC_ALL, "C");
+    ints = argsNew(intEdges, (int)(sizeof(intEdges) / sizeof(intEdges[0])),
+		intRandom, intExpect, &nints);
+    dbls = argsNew(dblEdges, (int)(sizeof(dblEdges) / sizeof(dblEdges[0])),
+		dblRandom, dblExpect, &ndbls);
+
+    fails += checkArgs("integer", ints, nints, "");
+    fails += checkArgs("double", dbls, ndbls, "");
+
+    /* The C locale radix is '.' whatever the locale. */
+    for (i = 0; i < sizeof(radixLocales) / sizeof(radixLocales[0]); i++) {
+	char where[64];
+	if (setlocale(LC_NUMERIC, radixLocales[i]) == NULL)
+	    continue;
+	if (strcmp(localeconv()->decimal_point, ".") == 0) {
+	    (void) setlocale(LC_NUMERIC, "C");
+	    continue;
+	}
+	(void) snprintf(where, sizeof(where), " in %s", radixLocales[i]);
+	fails += checkArgs("double", dbls, ndbls, where);
+	(void) setlocale(LC_NUMERIC, "C");
+	break;
+    }
+    if (i == sizeof(radixLocales) / sizeof(radixLocales[0]))
+	printf("locale radix check skipped: no locale with a ',' radix\n");
+
+    if (fails)
+	printf("%d checks FAILED\n", fails);
+    else
+	printf("all checks passed\n");
+
+    if (bench) {
+	struct numArg_s * shorts;
+	int nshorts;
+
+	shorts = argsNew(NULL, 0, dblShort, dblExpect, &nshorts);
+	printf("%8s %12s %12s %12s\n", "args", "libc ns/arg", "ns/arg", "C ns/arg");
+	benchArgs("integer", 0, ints, nints);
+	benchArgs("double", 1, dbls, ndbls);
+	benchArgs("short", 1, shorts, nshorts);
+	free(shorts);
+    }
+    free(ints);
+    free(dbls);
+    return (fails ? 1 : 0);
+}
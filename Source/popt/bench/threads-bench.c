@@ -0,0 +1,200 @@
+/** \ingroup popt
+ * \file popt/bench/threads-bench.c
+ * Parallel context checks and timings: threads each parse thousands of
+ * command lines in their own contexts, with config file aliases, bit
+ * sets and help output, and must all get the right values. Build with
+ * -fsanitize=thread to check that contexts share no state that popt
+ * writes. "-c" runs the checks only.
+ */
+
+#include "system.h"
+#include <time.h>
+#include <pthread.h>
+
+#define	BENCH_APP	"threads-bench"
+#define	NTHREADS	8
+#define	NCONTEXTS	3000
+
+/** A thread, and what it parsed. */
+struct worker_s {
+    pthread_t thread;
+    int id;
+    int n;
+    int fails;
+};
+
+/* Config file aliases, read by every context. */
+static char configFile[] = "/tmp/popt-threads-bench.XXXXXX";
+
+/**
+ * Return a monotonic time stamp.
+ * @return		time in ns
+ */
+static double bench_ns(void)
+	/*@*/
+{
+    struct timespec ts;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/**
+ * Parse one command line of every option type, and an alias from the
+ * config file, in a new context.
+ * @param id		thread no.
+ * @param it		command line no.
+ * @param fp		help output
+ * @return		no. of failures
+ */
+static int parseOne(int id, int it, FILE * fp)
+	/*@modifies fp @*/
+{
+    int i = 0;
+    int toggle = 0;
+    float f = 0.0f;
+    double d = 0.0;
+    long long ll = 0;
+    char * s = NULL;
+    const char ** av = NULL;
+    poptBits bits = NULL;
+    struct poptOption opts[] = {
+	{ "int", 'i', POPT_ARG_INT, &i, 0, "an int", "N" },
+	{ "toggle", 't', POPT_ARG_NONE, &toggle, 0, "a toggle", NULL },
+	{ "float", 'f', POPT_ARG_FLOAT, &f, 0, "a float", "F" },
+	{ "double", 'd', POPT_ARG_DOUBLE, &d, 0, "a double", "D" },
+	{ "longlong", 'l', POPT_ARG_LONGLONG, &ll, 0, "a long long", "L" },
+	{ "string", 's', POPT_ARG_STRING, &s, 0, "a string", "S" },
+	{ "add", 'a', POPT_ARG_ARGV, &av, 0, "an arg to collect", "A" },
+	{ "bits", 'b', POPT_ARG_BITSET, &bits, 0, "bits to set", "B,..." },
+	POPT_AUTOHELP
+	POPT_TABLEEND
+    };
+    char line[256];
+    const char ** argv = NULL;
+    int argc = 0;
+    poptContext con;
+    int rc = 0;
+    int xx;
+
+    (void) snprintf(line, sizeof(line), BENCH_APP
+	" --int=%d -t -f 1.5 --double 2.25 -l 0x%x --string 'x y'"
+	" -a one -a two --bits a,b,!c --seven", id, it);
+    if (poptParseArgvString(line, &argc, &argv))
+	return 1;
+    con = poptGetContext(BENCH_APP, argc, argv, opts,
+		(it & 1) ? POPT_CONTEXT_C_NUMERIC : 0);
+    if (con == NULL || poptReadConfigFile(con, configFile))
+	rc++;
+    while ((xx = poptGetNextOpt(con)) > 0)
+	{};
+
+    if (xx != -1 || i != 7 || !toggle || f != 1.5f || d != 2.25 || ll != it
+     || s == NULL || strcmp(s, "x y")
+     || av == NULL || av[0] == NULL || av[1] == NULL || strcmp(av[1], "two"))
+	rc++;
+    if (poptBitsChk(bits, "a") != 1 || poptBitsChk(bits, "c") != 0)
+	rc++;
+    else if (poptBitsClr(bits) || poptBitsChk(bits, "a") != 0)
+	rc++;
+    if (it % 100 == 0) {
+	poptPrintHelp(con, fp, 0);
+	poptPrintUsage(con, fp, 0);
+    }
+
+    (void) poptFreeContext(con);
+    free(argv);
+    free(s);
+    if (av != NULL) {
+	for (xx = 0; av[xx] != NULL; xx++)
+	    free((void *)av[xx]);
+	free(av);
+    }
+    free(bits);
+    return rc;
+}
+
+/**
+ * Parse a worker's command lines.
+ * @param arg		worker
+ * @return		NULL
+ */
+static void * workerRun(void * arg)
+	/*@*/
+{
+    struct worker_s * w = arg;
+    FILE * fp = fopen("/dev/null", "w");
+    int it;
+
+    if (fp == NULL) {
+	w->fails++;
+	return NULL;
+    }
+    for (it = 0; it < w->n; it++)
+	w->fails += parseOne(w->id, it, fp);
+    (void) fclose(fp);
+    return NULL;
+}
+
+/**
+ * Run threads each parsing their command lines.
+ * @param nthreads	no. of threads
+ * @param n		no. of command lines per thread
+ * @retval *nsp		run time in ns
+ * @return		no. of failures
+ */
+static int runThreads(int nthreads, int n, double * nsp)
+	/*@*/
+{
+    struct worker_s w[NTHREADS];
+    double t0 = bench_ns();
+    int fails = 0;
+    int i;
+
+    for (i = 0; i < nthreads; i++) {
+	w[i].id = i;
+	w[i].n = n;
+	w[i].fails = 0;
+	if (pthread_create(&w[i].thread, NULL, workerRun, w + i))
+	    exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < nthreads; i++) {
+	(void) pthread_join(w[i].thread, NULL);
+	fails += w[i].fails;
+    }
+    *nsp = bench_ns() - t0;
+    return fails;
+}
+
+int main(int argc, const char ** argv)
+{
+    int bench = !(argc > 1 && strcmp(argv[1], "-c") == 0);
+    static const char config[] = "threads-b* alias --seven --int=7\n";
+    double t;
+    int fails;
+    int fd;
+    int n;
+
+    if ((fd = mkstemp(configFile)) < 0)
+	exit(EXIT_FAILURE);
+    if (write(fd, config, sizeof(config) - 1) != (ssize_t)(sizeof(config) - 1)
+     || close(fd))
+	exit(EXIT_FAILURE);
+
+    fails = runThreads(NTHREADS, NCONTEXTS, &t);
+    if (fails)
+	printf("%d checks FAILED\n", fails);
+    else
+	printf("all checks passed\n");
+
+    if (bench) {
+	printf("%8s %12s %12s\n", "threads", "contexts/s", "us/context");
+	for (n = 1; n <= NTHREADS; n *= 2) {
+	    (void) runThreads(n, NCONTEXTS, &t);
+	    printf("%8d %12.0f %12.2f\n", n,
+		(double)n * NCONTEXTS / (t / 1e9), t / 1e3 / NCONTEXTS);
+	}
+    }
+    (void) unlink(configFile);
+    return (fails ? 1 : 0);
+}
@@ -56,9 +56,15 @@
 /* Define to 1 if you have the <memory.h> header file. */
 #define HAVE_MEMORY_H 1
 
+/* Define to 1 if you have a working `mmap' system call. */
+#define HAVE_MMAP 1
+
 /* Define to 1 if you have the `mtrace' function. */
 /* #undef HAVE_MTRACE */
 
+/* Define to 1 if you have the `posix_memalign' function. */
+#define HAVE_POSIX_MEMALIGN 1
+
 /* Define to 1 if you have the `setregid' function. */
 #define HAVE_SETREGID 1
 
@@ -83,6 +89,9 @@
 /* Define to 1 if you have the <string.h> header file. */
 #define HAVE_STRING_H 1
 
+/* Define to 1 if you have the <sys/mman.h> header file. */
+#define HAVE_SYS_MMAN_H 1
+
 /* Define to 1 if you have the <sys/stat.h> header file. */
 #define HAVE_SYS_STAT_H 1
 
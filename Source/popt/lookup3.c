@@ -4,9 +4,10 @@
  * 
  * These are functions for producing 32-bit hashes for hash table lookup.
  * jlu32w(), jlu32l(), jlu32lpair(), jlu32b(), _JLU3_MIX(), and _JLU3_FINAL() 
- * are externally useful functions.  Routines to test the hash are included 
- * if SELF_TEST is defined.  You can use this free for any purpose.  It's in
- * the public domain.  It has no warranty.
+ * are externally useful functions.  Routines to test and time the hash are
+ * included if _JLU3_SELFTEST is defined (cmake -DPOPT_BUILD_BENCHMARKS=ON
+ * builds them as lookup3-bench).  You can use this free for any purpose.
+ * It's in the public domain.  It has no warranty.
  * 
  * You probably want to use jlu32l().  jlu32l() and jlu32b()
  * hash byte arrays.  jlu32l() is is faster than jlu32b() on
@@ -34,12 +35,18 @@
 */
 /* -------------------------------------------------------------------- */
 
+#include <stddef.h>
 #include <stdint.h>
 
 #if defined(_JLU3_SELFTEST)
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <time.h>
 # define _JLU3_jlu32w		1
 # define _JLU3_jlu32l		1
 # define _JLU3_jlu32lpair	1
+# define _JLU3_jlu32lpairN	1
 # define _JLU3_jlu32b		1
 #endif
 
@@ -192,8 +199,8 @@ uint32_t jlu32w(uint32_t h, const uint32_t *k, size_t size)
 
     /*----------------------------------------- handle the last 3 uint32_t's */
     switch (size) {
-    case 3 : c+=k[2];
-    case 2 : b+=k[1];
+    case 3 : c+=k[2];	/*@fallthrough@*/
+    case 2 : b+=k[1];	/*@fallthrough@*/
     case 1 : a+=k[0];
 	_JLU3_FINAL(a,b,c);
 	/*@fallthrough@*/
@@ -636,6 +643,175 @@ exit:
 }
 #endif	/* defined(_JLU3_jlu32lpair) */
 
+#if defined(_JLU3_jlu32lpairN)
+#include <string.h>
+
+/* Read 4 key bytes as a little-endian word, at any alignment. */
+static inline uint32_t _jlu3_le32(const uint8_t *k)
+	/*@*/
+{
+    uint32_t w;
+    memcpy(&w, k, sizeof(w));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap32(w);
+#endif
+    return w;
+}
+
+/* Add the last (partial, zero padded) block of a key to (a,b,c). */
+static inline void _jlu3_last(const uint8_t *k, size_t size,
+		uint32_t *a, uint32_t *b, uint32_t *c)
+	/*@modifies *a, *b, *c @*/
+{
+    uint32_t w[4] = { 0, 0, 0, 0 };
+    size_t n = size >> 2;
+
+    switch (n) {
+    case 3:	w[2] = _jlu3_le32(k + 8);	/*@fallthrough@*/
+    case 2:	w[1] = _jlu3_le32(k + 4);	/*@fallthrough@*/
+    case 1:	w[0] = _jlu3_le32(k);		break;
+    case 0:	break;
+    }
+    k += 4 * n;
+    switch (size & 3) {
+    case 3:	w[n] |= ((uint32_t)k[2]) << 16;	/*@fallthrough@*/
+    case 2:	w[n] |= ((uint32_t)k[1]) << 8;	/*@fallthrough@*/
+    case 1:	w[n] |= ((uint32_t)k[0]);	break;
+    case 0:	break;
+    }
+    *a += w[0];
+    *b += w[1];
+    *c += w[2];
+}
+
+/**
+ * Finish jlu32lpair() of a key from the (a,b,c) state after its first
+ * blocks, reading the rest of the key a word at a time.
+ * @param k		the rest of the key
+ * @param size		the size of the rest of the key in bytes
+ * @param a, b, c	the state
+ * @retval *pc		primary hash
+ * @retval *pb		secondary hash
+ */
+static void _jlu3_pairtail(const uint8_t *k, size_t size,
+		uint32_t a, uint32_t b, uint32_t c, uint32_t *pc, uint32_t *pb)
+	/*@modifies *pc, *pb @*/
+{
+    while (size > (size_t)12) {
+	a += _jlu3_le32(k);
+	b += _jlu3_le32(k + 4);
+	c += _jlu3_le32(k + 8);
+	_JLU3_MIX(a,b,c);
+	size -= 12;
+	k += 12;
+    }
+    if (size > 0) {
+	_jlu3_last(k, size, &a, &b, &c);
+	_JLU3_FINAL(a,b,c);
+    }
+    *pc = c;
+    *pb = b;
+}
+
+#if defined(__GNUC__)
+# if defined(__AVX512F__)
+#  define _JLU3_LANES	16
+# elif defined(__AVX2__)
+#  define _JLU3_LANES	8
+# else
+#  define _JLU3_LANES	4
+# endif
+typedef uint32_t _jlu3_vec
+	__attribute__((__vector_size__(_JLU3_LANES * sizeof(uint32_t))));
+#else
+# define _JLU3_LANES	1
+typedef uint32_t _jlu3_vec;
+#endif
+
+#define	_JLU3_BATCH	32	/* keys per pass */
+
+/* Load (store) _JLU3_LANES words of a pass. */
+static inline _jlu3_vec _jlu3_load(const uint32_t *p)
+	/*@*/
+{
+    _jlu3_vec v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void _jlu3_store(uint32_t *p, _jlu3_vec v)
+	/*@modifies *p @*/
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+/**
+ * jlu32lpairN: jlu32lpair() of n keys, _JLU3_LANES keys abreast.
+ *
+ * Keys of 1 to 12 bytes (option names, arguments, attributes) are a single
+ * block, and most of their hashing is the final mix.  Such keys are
+ * gathered, a pass of _JLU3_BATCH keys at a time, into 3 arrays of (a,b,c)
+ * words, and then finally mixed a vector of _JLU3_LANES keys at a time.
+ * Other keys are hashed one at a time.  The hashes are identical to those
+ * of jlu32lpair(), and keys are never read past their end.
+ *
+ * @param n		no. of keys
+ * @param keys		the keys, arrays of uint8_t values
+ * @param sizes		the sizes of the keys in bytes
+ * @retval pc		IN: primary initvals, OUT: primary hashes
+ * @retval pb		IN: secondary initvals, OUT: secondary hashes
+ */
+void jlu32lpairN(size_t n, const void * const *keys, const size_t *sizes,
+		uint32_t *pc, uint32_t *pb)
+{
+    uint32_t ka[_JLU3_BATCH], kb[_JLU3_BATCH], kc[_JLU3_BATCH];
+    size_t ix[_JLU3_BATCH];
+    size_t i, j;
+
+    for (i = 0; i < n; i += _JLU3_BATCH) {
+	size_t ni = (n - i < _JLU3_BATCH ? n - i : _JLU3_BATCH);
+	size_t nv = 0;
+
+	for (j = i; j < i + ni; j++) {
+	    size_t size = sizes[j];
+	    uint32_t a = _JLU3_INIT(pc[j], size);
+
+	    if (keys[j] == NULL) {
+		pc[j] = pb[j] = a;
+	    } else if (size == 0) {
+		pc[j] = a + pb[j];
+		pb[j] = a;
+	    } else if (size > (size_t)12) {
+		_jlu3_pairtail((const uint8_t *) keys[j], size, a, a, a + pb[j],
+			&pc[j], &pb[j]);
+	    } else {
+		ka[nv] = kb[nv] = a;
+		kc[nv] = a + pb[j];
+		_jlu3_last((const uint8_t *) keys[j], size,
+			&ka[nv], &kb[nv], &kc[nv]);
+		ix[nv++] = j;
+	    }
+	}
+	for (j = nv; j % _JLU3_LANES; j++)
+	    ka[j] = kb[j] = kc[j] = 0;
+
+	/*------------------------------------ final mix of one block keys */
+	for (j = 0; j < nv; j += _JLU3_LANES) {
+	    _jlu3_vec a = _jlu3_load(ka + j);
+	    _jlu3_vec b = _jlu3_load(kb + j);
+	    _jlu3_vec c = _jlu3_load(kc + j);
+	    _JLU3_FINAL(a,b,c);
+	    _jlu3_store(kb + j, b);
+	    _jlu3_store(kc + j, c);
+	}
+	for (j = 0; j < nv; j++) {
+	    pc[ix[j]] = kc[j];
+	    pb[ix[j]] = kb[j];
+	}
+    }
+}
+#endif	/* defined(_JLU3_jlu32lpairN) */
+
 #if defined(_JLU3_jlu32b)
 uint32_t jlu32b(uint32_t h, /*@null@*/ const void *key, size_t size)
 	/*@*/;
@@ -777,22 +953,145 @@ exit:
 
 #if defined(_JLU3_SELFTEST)
 
-/* used for timings */
-static void driver1(void)
+/* nanoseconds of a monotonic clock */
+static double driver_ns(void)
 	/*@*/
 {
-    uint8_t buf[256];
-    uint32_t i;
-    uint32_t h=0;
-    time_t a,z;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
 
-    time(&a);
-    for (i=0; i<256; ++i) buf[i] = 'x';
-    for (i=0; i<1; ++i) {
-	h = jlu32l(h, &buf[0], sizeof(buf[0]));
+/* cycles of the time stamp counter (at the nominal clock), where there is one */
+static double driver_cycles(void)
+	/*@*/
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return (double) __builtin_ia32_rdtsc();
+#else
+    return 0.0;
+#endif
+}
+
+#define	DRIVER1_L	0	/* jlu32l */
+#define	DRIVER1_B	1	/* jlu32b */
+#define	DRIVER1_W	2	/* jlu32w */
+#define	DRIVER1_LPAIR	3	/* jlu32lpair */
+#define	DRIVER1_LPAIRN	4	/* jlu32lpairN, 64 keys a call */
+#define	DRIVER1_BATCH	64
+
+/* hash nkeys keys of size bytes at buf+off (keys overlap), n times */
+static uint32_t driver1_run(int fn, const uint8_t *buf, size_t off,
+		size_t size, size_t n)
+	/*@*/
+{
+    const void *keys[DRIVER1_BATCH];
+    size_t sizes[DRIVER1_BATCH];
+    uint32_t pc[DRIVER1_BATCH], pb[DRIVER1_BATCH];
+    uint32_t h = 0;
+    size_t i, j;
+
+    switch (fn) {
+    case DRIVER1_L:
+	for (i = 0; i < n; i++)
+	    h += jlu32l(h, buf + off + (i & 63), size);
+	break;
+    case DRIVER1_B:
+	for (i = 0; i < n; i++)
+	    h += jlu32b(h, buf + off + (i & 63), size);
+	break;
+    case DRIVER1_W:
+	for (i = 0; i < n; i++)
+	    h += jlu32w(h, (const uint32_t *)(buf + 4 * (i & 15)), size / 4);
+	break;
+    case DRIVER1_LPAIR:
+	for (i = 0; i < n; i++) {
+	    uint32_t c = h, b = 0;
+	    jlu32lpair(buf + off + (i & 63), size, &c, &b);
+	    h += c ^ b;
+	}
+	break;
+    case DRIVER1_LPAIRN:
+	for (j = 0; j < DRIVER1_BATCH; j++) {
+	    keys[j] = buf + off + j;
+	    sizes[j] = size;
+	}
+	for (i = 0; i < n; i += DRIVER1_BATCH) {
+	    for (j = 0; j < DRIVER1_BATCH; j++)
+		pc[j] = pb[j] = h;
+	    jlu32lpairN(DRIVER1_BATCH, keys, sizes, pc, pb);
+	    h += pc[0] ^ pb[DRIVER1_BATCH - 1];
+	}
+	break;
     }
-    time(&z);
-    if (z-a > 0) printf("time %d %.8x\n", (int)(z-a), h);
+    return h;
+}
+
+/*
+ * time the hashes, in ns and cycles per key and bytes per cycle.  Each key
+ * is seeded with the previous hash, so this is the latency of a hash, but
+ * for jlu32lpairN(), whose batches of keys are independent.
+ */
+static void driver1(void)
+	/*@*/
+{
+    static const char *names[] = {
+	"jlu32l", "jlu32b", "jlu32w", "jlu32lpair", "jlu32lpairN"
+    };
+    static const size_t sizes[] = { 4, 8, 12, 16, 32, 64, 256, 1024, 4096 };
+    uint32_t *words = malloc(4096 + 64 + 8);
+    uint8_t *buf = (uint8_t *) words;
+    uint32_t h = 0;
+    size_t i, j, off;
+    int fn;
+
+    if (buf == NULL)
+	return;
+    for (i = 0; i < 4096 + 64 + 8; i++)
+	buf[i] = (uint8_t)(i * 37 + 11);
+
+    printf("%-12s %5s %3s %10s %10s %10s %10s\n", "function", "bytes",
+	"off", "ns/key", "cycles/key", "bytes/ns", "bytes/cycle");
+    for (fn = DRIVER1_L; fn <= DRIVER1_LPAIRN; fn++) {
+	for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+	    for (off = 0; off < 4; off++) {
+		double ns = 1e30, cycles = 1e30;
+		size_t n = DRIVER1_BATCH;
+		int rep;
+
+		/* jlu32w() hashes aligned words only */
+		if (fn == DRIVER1_W && off > 0)
+		    break;
+
+		/* enough keys for 10 ms, best of 5 */
+		while (n < ((size_t)1 << 30)) {
+		    double t0 = driver_ns();
+		    h += driver1_run(fn, buf, off, sizes[j], n);
+		    if (driver_ns() - t0 > 1e7)
+			break;
+		    n *= 2;
+		}
+		for (rep = 0; rep < 5; rep++) {
+		    double t0 = driver_ns(), c0 = driver_cycles();
+		    h += driver1_run(fn, buf, off, sizes[j], n);
+		    c0 = driver_cycles() - c0;
+		    t0 = driver_ns() - t0;
+		    if (t0 < ns)
+			ns = t0;
+		    if (c0 < cycles)
+			cycles = c0;
+		}
+		ns /= n;
+		cycles /= n;
+		printf("%-12s %5u %3u %10.2f %10.2f %10.3f %10.3f\n",
+			names[fn], (unsigned) sizes[j], (unsigned) off, ns,
+			cycles, sizes[j] / ns,
+			(cycles > 0.0 ? sizes[j] / cycles : 0.0));
+	    }
+	}
+    }
+    printf("(%.8x)\n\n", h);
+    free(words);
 }
 
 /* check that every input bit changes every output bit half the time */
@@ -800,9 +1099,10 @@ static void driver1(void)
 #define HASHLEN   1
 #define MAXPAIR 60
 #define MAXLEN  70
-static void driver2(void)
+static int driver2(void)
 	/*@*/
 {
+    int rc = 0;
     uint8_t qa[MAXLEN+1], qb[MAXLEN+2], *a = &qa[0], *b = &qb[1];
     uint32_t c[HASHSTATE], d[HASHSTATE], i=0, j=0, k, l, m=0, z;
     uint32_t e[HASHSTATE],f[HASHSTATE],g[HASHSTATE],h[HASHSTATE];
@@ -848,6 +1148,7 @@ static void driver2(void)
 			printf("%.8x %.8x %.8x %.8x %.8x %.8x  ",
 				e[0],f[0],g[0],h[0],x[0],y[0]);
 			printf("i %d j %d m %d len %d\n", i, j, m, hlen);
+			rc++;
 		    }
 		    if (z == MAXPAIR) goto done;
 		}
@@ -860,12 +1161,14 @@ static void driver2(void)
 	}
     }
     printf("\n");
+    return rc;
 }
 
 /* Check for reading beyond the end of the buffer and alignment problems */
-static void driver3(void)
+static int driver3(void)
 	/*@*/
 {
+    int rc = 0;
     uint8_t buf[MAXLEN+20], *b;
     uint32_t len;
     uint8_t q[] = "This is the time for all good men to come to the aid of their country...";
@@ -930,40 +1233,94 @@ static void driver3(void)
 	    *(b-1)=(uint8_t)~0;
 	    x = jlu32l(m, b, len);
 	    y = jlu32l(m, b, len);
-	    if ((ref != x) || (ref != y)) 
+	    if ((ref != x) || (ref != y)) {
 		printf("alignment error: %.8x %.8x %.8x %d %d\n",ref,x,y, h, i);
+		rc++;
+	    }
 	}
     }
+    return rc;
 }
 
 /* check for problems with nulls */
-static void driver4(void)
+static int driver4(void)
 	/*@*/
 {
     uint8_t buf[1];
-    uint32_t h;
+    uint32_t h, hprev;
+    int rc = 0;
     uint32_t i;
-    uint32_t state[HASHSTATE];
 
     buf[0] = ~0;
-    for (i=0; i<HASHSTATE; ++i)
-	state[i] = 1;
     printf("These should all be different\n");
     h = 0;
     for (i=0; i<8; ++i) {
+	hprev = h;
 	h = jlu32l(h, buf, 0);
 	printf("%2ld  0-byte strings, hash is  %.8x\n", (long)i, h);
+	if (h == hprev)
+	    rc++;
     }
+    return rc;
 }
 
+/* check that batched hashes are the same as one at a time */
+static int driver5(void)
+	/*@*/
+{
+    int rc = 0;
+    uint8_t buf[MAXLEN+4];
+    const void *keys[MAXLEN+2];
+    size_t sizes[MAXLEN+2];
+    uint32_t pc[MAXLEN+2], pb[MAXLEN+2];
+    uint32_t c, b;
+    uint32_t i, off;
+
+    for (i=0; i<sizeof(buf); ++i)
+	buf[i] = (uint8_t)(i*37 + 11);
+    for (off=0; off<4; ++off) {
+	for (i=0; i<MAXLEN+2; ++i) {
+	    keys[i] = (i == MAXLEN+1 ? NULL : &buf[off]);
+	    sizes[i] = (i < MAXLEN ? i : 7);
+	    pc[i] = i;
+	    pb[i] = ~i;
+	}
+	jlu32lpairN(MAXLEN+2, keys, sizes, pc, pb);
+	for (i=0; i<MAXLEN+2; ++i) {
+	    c = i;
+	    b = ~i;
+	    jlu32lpair(keys[i], sizes[i], &c, &b);
+	    if (c != pc[i] || b != pb[i]) {
+		printf("batch error: %.8x %.8x %.8x %.8x %d %d\n",
+			c, b, pc[i], pb[i], off, i);
+		rc++;
+	    }
+	}
+    }
+    return rc;
+}
 
+/*
+ * usage: lookup3-bench [-c]
+ * Runs the checks, then (unless -c) the timings.  Exits non-zero if any
+ * check fails.
+ */
 int main(int argc, char ** argv)
 {
-    driver1();	/* test that the key is hashed: used for timings */
-    driver2();	/* test that whole key is hashed thoroughly */
-    driver3();	/* test that nothing but the key is hashed */
-    driver4();	/* test hashing multiple buffers (all buffers are null) */
-    return 1;
+    int rc = 0;
+
+    rc += driver2();	/* test that whole key is hashed thoroughly */
+    rc += driver3();	/* test that nothing but the key is hashed */
+    rc += driver4();	/* test hashing multiple buffers (all buffers are null) */
+    rc += driver5();	/* test hashing keys in batches */
+    if (rc)
+	printf("%d checks FAILED\n", rc);
+    else
+	printf("all checks passed\n");
+
+    if (!(argc > 1 && !strcmp(argv[1], "-c")))
+	driver1();	/* time the hashes */
+    return (rc ? 1 : 0);
 }
 
 #endif  /* _JLU3_SELFTEST */
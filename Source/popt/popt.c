@@ -22,6 +22,14 @@ extern long long int strtoll(const char *nptr, /*@null@*/ char **endptr,
 #include <float.h>
 #endif
 #include <math.h>
+#ifndef M_LN2
+#define M_LN2	0.69314718055994530942
+#endif
+#include <locale.h>
+#include <sys/stat.h>
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#endif
 
 #include "poptint.h"
 
@@ -31,9 +39,9 @@ int _popt_debug = 0;
 #endif
 
 /*@unchecked@*/
-unsigned int _poptArgMask = POPT_ARG_MASK;
+const unsigned int _poptArgMask = POPT_ARG_MASK;
 /*@unchecked@*/
-unsigned int _poptGroupMask = POPT_GROUP_MASK;
+const unsigned int _poptGroupMask = POPT_GROUP_MASK;
 
 #if !defined(HAVE_STRERROR) && !defined(__LCLINT__)
 static char * strerror(int errno)
@@ -81,7 +89,7 @@ static void invokeCallbacksPRE(poptContext con, const struct poptOption * opt)
 	if (arg.ptr)
 	switch (poptArgType(opt)) {
 	case POPT_ARG_INCLUDE_TABLE:	/* Recurse on included sub-tables. */
-	    poptSubstituteHelpI18N(arg.opt);	/* XXX side effects */
+	    arg.opt = poptSubstituteHelpI18N(arg.opt);
 	    invokeCallbacksPRE(con, arg.opt);
 	    /*@switchbreak@*/ break;
 	case POPT_ARG_CALLBACK:		/* Perform callback. */
@@ -105,7 +113,7 @@ static void invokeCallbacksPOST(poptContext con, const struct poptOption * opt)
 	if (arg.ptr)
 	switch (poptArgType(opt)) {
 	case POPT_ARG_INCLUDE_TABLE:	/* Recurse on included sub-tables. */
-	    poptSubstituteHelpI18N(arg.opt);	/* XXX side effects */
+	    arg.opt = poptSubstituteHelpI18N(arg.opt);
 	    invokeCallbacksPOST(con, arg.opt);
 	    /*@switchbreak@*/ break;
 	case POPT_ARG_CALLBACK:		/* Perform callback. */
@@ -134,7 +142,7 @@ static void invokeCallbacksOPTION(poptContext con,
 	poptArg arg = { .ptr = opt->arg };
 	switch (poptArgType(opt)) {
 	case POPT_ARG_INCLUDE_TABLE:	/* Recurse on included sub-tables. */
-	    poptSubstituteHelpI18N(arg.opt);	/* XXX side effects */
+	    arg.opt = poptSubstituteHelpI18N(arg.opt);
 	    if (opt->arg != NULL)
 		invokeCallbacksOPTION(con, opt->arg, myOpt, myData, shorty);
 	    /*@switchbreak@*/ break;
@@ -184,6 +192,7 @@ poptContext poptGetContext(const char * name, int argc, const char ** argv,
 	con->os->next = 1;		/* skip argv[0] */
 
     con->leftovers = calloc( (size_t)(argc + 1), sizeof(*con->leftovers) );
+    con->leftoversAlloced = (con->leftovers != NULL ? argc + 1 : 0);
 /*@-dependenttrans -assignexpose@*/	/* FIX: W2DO? */
     con->options = options;
 /*@=dependenttrans =assignexpose@*/
@@ -208,16 +217,142 @@ poptContext poptGetContext(const char * name, int argc, const char ** argv,
     return con;
 }
 
+poptContext poptGetStreamContext(const char * name,
+		poptArgIterator next, void * data,
+		const struct poptOption * options, unsigned int flags)
+{
+    struct poptStream_s * st;
+    const char * argv0;
+    poptContext con;
+
+    if (next == NULL || (st = calloc(1, sizeof(*st))) == NULL)
+	return NULL;
+    st->next = next;
+    st->data = data;
+    argv0 = (*next) (data);
+    st->done = (argv0 == NULL);
+    st->argv0 = xstrdup(argv0 ? argv0 : "");
+    st->argv[0] = st->argv0;
+
+    /* Pulled args are transient: no leftovers, no execs. */
+    con = poptGetContext(name, 1, st->argv, options,
+		flags | POPT_CONTEXT_ARG_OPTS | POPT_CONTEXT_NO_EXEC);
+    if (con == NULL) {
+	st->argv0 = _free(st->argv0);
+	st = _free(st);
+	return NULL;
+    }
+    con->stream = st;
+    return con;
+}
+
+/**
+ * Pull the next arg of a stream context into the base option stack entry.
+ * The buffer of the arg before the previous one is recycled, so the
+ * previous arg (e.g. an option waiting for its value) stays valid.
+ * @param con		context
+ * @return		1 if an arg was pulled, 0 otherwise, POPT_ERROR_MALLOC
+ *			if an arg (pulled now or before) couldn't be kept
+ */
+static int poptStreamPull(poptContext con)
+	/*@modifies con @*/
+{
+    struct optionStackEntry * os = con->optionStack;
+    struct poptStream_s * st = con->stream;
+    const char * s;
+    size_t ns;
+    size_t nb;
+    char * t;
+
+    if (st == NULL || con->os != os || os->next < os->argc)
+	return 0;
+    if (st->error)
+	return st->error;
+    if (st->done)
+	return 0;
+    if ((s = (*st->next) (st->data)) == NULL) {
+	st->done = 1;
+	return 0;
+    }
+
+    ns = strlen(s) + 1;
+    t = st->buf[0];
+    nb = st->size[0];
+    st->buf[0] = st->buf[1];
+    st->size[0] = st->size[1];
+    if (nb < ns) {
+	nb = (ns < 64 ? 64 : ns);
+	t = _free(t);
+	if ((t = malloc(nb)) == NULL) {
+	    nb = 0;
+	    st->error = POPT_ERROR_MALLOC;
+	}
+    }
+    st->buf[1] = t;
+    st->size[1] = nb;
+    if (t == NULL)
+	return st->error;
+    memcpy(t, s, ns);
+
+    st->argv[1] = (st->buf[0] ? st->buf[0] : st->argv0);
+    st->argv[2] = st->buf[1];
+    st->argv[3] = NULL;
+    os->argv = st->argv;
+    os->argc = 3;
+    os->next = 2;
+    return 1;
+}
+
+/**
+ * Free a stream context argument source.
+ * @param st		stream argument source
+ * @return		NULL always
+ */
+static /*@null@*/ void * poptStreamFree(/*@only@*/ /*@null@*/ struct poptStream_s * st)
+	/*@modifies st @*/
+{
+    if (st != NULL) {
+	st->argv0 = _free(st->argv0);
+	st->buf[0] = _free(st->buf[0]);
+	st->buf[1] = _free(st->buf[1]);
+	st = _free(st);
+    }
+    return NULL;
+}
+
 static void cleanOSE(/*@special@*/ struct optionStackEntry *os)
 	/*@uses os @*/
-	/*@releases os->nextArg, os->argv, os->argb @*/
+	/*@releases os->nextArg, os->argvbuf, os->argb @*/
 	/*@modifies os @*/
 {
     os->nextArg = _free(os->nextArg);
-    os->argv = _free(os->argv);
+    os->argv = NULL;
+    os->argvbuf = _free(os->argvbuf);
     os->argb = PBM_FREE(os->argb);
 }
 
+/**
+ * Release the response file buffers of a context.
+ * @param con		context
+ */
+static void poptFreeFileBufs(poptContext con)
+	/*@modifies con @*/
+{
+    int i;
+
+    for (i = 0; i < con->numFileBufs; i++) {
+	struct poptFileBuf_s * fb = con->fileBufs + i;
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+	if (fb->nmapped > 0)
+	    (void) munmap(fb->b, fb->nmapped);
+	else
+#endif
+	    free(fb->b);
+    }
+    con->fileBufs = _free(con->fileBufs);
+    con->numFileBufs = 0;
+}
+
 void poptResetContext(poptContext con)
 {
     int i;
@@ -229,8 +364,11 @@ void poptResetContext(poptContext con)
     con->os->argb = PBM_FREE(con->os->argb);
     con->os->currAlias = NULL;
     con->os->nextCharArg = NULL;
-    con->os->nextArg = NULL;
+    con->os->nextArg = _free(con->os->nextArg);
     con->os->next = 1;			/* skip argv[0] */
+    /* A stream can't be rewound, carry on after the last pulled arg. */
+    if (con->stream != NULL)
+	con->os->next = con->os->argc;
 
     con->numLeftovers = 0;
     con->nextLeftover = 0;
@@ -246,12 +384,79 @@ void poptResetContext(poptContext con)
 
     con->finalArgvCount = 0;
     con->arg_strip = PBM_FREE(con->arg_strip);
+    /* The application owns the vectors, and may free them after a reset. */
+    con->argvTargets = _free(con->argvTargets);
+    con->numArgvTargets = 0;
+    poptFreeFileBufs(con);
 /*@-nullstate@*/	/* FIX: con->finalArgv != NULL */
     return;
 /*@=nullstate@*/
 }
 
-/* Only one of longName, shortName should be set, not both. */
+/**
+ * Make room for n more finalArgv entries.
+ * Capacity doubles, so recording N options costs amortized O(1) each.
+ * @param con		context
+ * @param n		no. of entries about to be added
+ * @return		0 on success, POPT_ERROR_MALLOC on failure
+ */
+static int poptGrowFinalArgv(poptContext con, int n)
+	/*@modifies con @*/
+{
+    int alloced = con->finalArgvAlloced;
+    poptArgv av;
+
+    if ((con->finalArgvCount + n) < alloced)
+	return 0;
+
+    if (alloced < 16)
+	alloced = 16;
+    while ((con->finalArgvCount + n) >= alloced)
+	alloced *= 2;
+    av = realloc(con->finalArgv, sizeof(*con->finalArgv) * alloced);
+    if (av == NULL)
+	return POPT_ERROR_MALLOC;
+    con->finalArgv = av;
+    con->finalArgvAlloced = alloced;
+    return 0;
+}
+
+/**
+ * Append a non-option arg to the leftovers.
+ * Response files can add args, so capacity isn't bounded by the base argc.
+ * @param con		context
+ * @param s		arg
+ * @return		0 on success, POPT_ERROR_MALLOC on failure
+ */
+static int poptAddLeftover(poptContext con, /*@dependent@*/ const char * s)
+	/*@modifies con @*/
+{
+    /* Keep a slot for the NULL that poptGetArgs() appends. */
+    if ((con->numLeftovers + 1) >= con->leftoversAlloced) {
+	int alloced = 2 * con->leftoversAlloced;
+	poptArgv av;
+
+	if (alloced < 16)
+	    alloced = 16;
+	av = realloc(con->leftovers, sizeof(*con->leftovers) * alloced);
+	if (av == NULL)
+	    return POPT_ERROR_MALLOC;
+	con->leftovers = av;
+	con->leftoversAlloced = alloced;
+    }
+    con->leftovers[con->numLeftovers++] = s;
+    return 0;
+}
+
+/**
+ * Handle an exec option.
+ * Only one of longName, shortName should be set, not both.
+ * @param con		context
+ * @param longName	long option name (or NULL)
+ * @param shortName	short option name (or '\0')
+ * @return		1 if handled, 0 if not an exec option,
+ *			POPT_ERROR_MALLOC on failure
+ */
 static int handleExec(/*@special@*/ poptContext con,
 		/*@null@*/ const char * longName, char shortName)
 	/*@uses con->execs, con->numExecs, con->flags, con->doExec,
@@ -286,11 +491,8 @@ static int handleExec(/*@special@*/ poptContext con,
 
     /* We already have an exec to do; remember this option for next
        time 'round */
-    if ((con->finalArgvCount + 1) >= (con->finalArgvAlloced)) {
-	con->finalArgvAlloced += 10;
-	con->finalArgv = realloc(con->finalArgv,
-			sizeof(*con->finalArgv) * con->finalArgvAlloced);
-    }
+    if (poptGrowFinalArgv(con, 1))
+	return POPT_ERROR_MALLOC;
 
     i = con->finalArgvCount++;
     if (con->finalArgv != NULL)	/* XXX can't happen */
@@ -399,30 +601,144 @@ static int handleAlias(/*@special@*/ poptContext con,
     con->os->nextArg = NULL;
     con->os->nextCharArg = NULL;
     con->os->currAlias = con->aliases + i;
-    {	const char ** av;
+    con->os->argvbuf = NULL;
+    {	const char ** av = con->os->currAlias->argv;
 	int ac = con->os->currAlias->argc;
-	/* Append --foo=bar arg to alias argv array (if present). */ 
+
+	/*
+	 * The alias argv lives as long as the context, and a "--foo=bar"
+	 * tail points into the argv of an entry below this one on the
+	 * stack, so the slice can reference both without copying strings.
+	 */
+	rc = 0;
+	if (ac <= 0 || av == NULL)
+	    rc = POPT_ERROR_NOARG;
+	else
+	/* Append --foo=bar arg to alias argv array (if present). */
 	if (longName && nextArg != NULL && *nextArg != '\0') {
-	    av = malloc((ac + 1 + 1) * sizeof(*av));
-	    if (av != NULL) {	/* XXX won't happen. */
-		for (i = 0; i < ac; i++) {
-		    av[i] = con->os->currAlias->argv[i];
-		}
-		av[ac++] = nextArg;
-		av[ac] = NULL;
-	    } else	/* XXX revert to old popt behavior if malloc fails. */
-		av = con->os->currAlias->argv;
-	} else
-	    av = con->os->currAlias->argv;
-	rc = poptDupArgv(ac, av, &con->os->argc, &con->os->argv);
-	if (av != NULL && av != con->os->currAlias->argv)
-	    free(av);
+	    const char ** argvbuf = malloc((ac + 1 + 1) * sizeof(*argvbuf));
+	    if (argvbuf != NULL) {
+		memcpy(argvbuf, av, ac * sizeof(*argvbuf));
+		argvbuf[ac++] = nextArg;
+		argvbuf[ac] = NULL;
+		con->os->argvbuf = av = argvbuf;
+	    } else
+		rc = POPT_ERROR_MALLOC;
+	}
+	con->os->argc = (rc ? 0 : ac);
+	con->os->argv = (rc ? NULL : av);
     }
     con->os->argb = NULL;
 
+    /* Plan finalArgv for the expansion: each arg may record 2 entries. */
+    if (rc == 0)
+	(void) poptGrowFinalArgv(con, 2 * con->os->argc);
+
     return (rc ? rc : 1);
 }
 
+/**
+ * Push the args of a "@file" response file onto the option stack.
+ * The file is mapped privately and split in place with
+ * poptParseArgvString() quoting rules, so the args of the new stack entry
+ * point into the mapping. Files that can't be mapped (or whose size is a
+ * multiple of the page size, leaving no room for a NUL) are read instead.
+ * @param con		context
+ * @param fn		response file name
+ * @return		0 on success, POPT_ERROR_* on failure
+ */
+static int handleResponseFile(/*@special@*/ poptContext con, const char * fn)
+	/*@uses con->optionStack, con->os @*/
+	/*@globals fileSystem, internalState @*/
+	/*@modifies con, fileSystem, internalState @*/
+{
+    struct poptFileBuf_s * fb;
+    char * b = NULL;
+    size_t nmapped = 0;
+    const char ** av = NULL;
+    int ac = 0;
+    int rc;
+
+    if ((con->os - con->optionStack + 1) == POPT_OPTION_DEPTH)
+	return POPT_ERROR_OPTSTOODEEP;
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+    {	long pagesize = sysconf(_SC_PAGESIZE);
+	struct stat sb;
+	int fdno = open(fn, O_RDONLY);
+
+	if (fdno < 0)
+	    return POPT_ERROR_ERRNO;
+	if (fstat(fdno, &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_size > 0
+	 && pagesize > 0 && (sb.st_size % pagesize) != 0)
+	{
+	    void * p = mmap(NULL, (size_t)sb.st_size, PROT_READ|PROT_WRITE,
+			MAP_PRIVATE, fdno, 0);
+	    if (p != MAP_FAILED) {
+		b = p;
+		nmapped = (size_t)sb.st_size;
+		/*
+		 * The rest of the last page is private and zero filled;
+		 * terminate explicitly in case the file grew meanwhile.
+		 */
+		b[nmapped] = '\0';
+	    }
+	}
+	(void) close(fdno);
+    }
+#endif
+
+    if (b == NULL && (rc = poptReadFile(fn, &b, NULL, 0)) != 0)
+	return rc;
+
+    rc = poptArgvScan(b, NULL, NULL, &ac, NULL);
+    if (rc == 0 && ac > 0) {
+	if ((av = malloc((ac + 1) * sizeof(*av))) != NULL) {
+	    (void) poptArgvScan(b, b, av, &ac, NULL);
+	    av[ac] = NULL;
+	} else
+	    rc = POPT_ERROR_MALLOC;
+    }
+
+    /* The buffer is owned by the context from here on. */
+    fb = realloc(con->fileBufs, (con->numFileBufs + 1) * sizeof(*fb));
+    if (fb != NULL) {
+	con->fileBufs = fb;
+	fb += con->numFileBufs++;
+	fb->b = b;
+	fb->nmapped = nmapped;
+    } else {
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+	if (nmapped > 0)
+	    (void) munmap(b, nmapped);
+	else
+#endif
+	    free(b);
+	if (rc == 0)
+	    rc = POPT_ERROR_MALLOC;
+    }
+
+    if (rc != 0 || ac == 0) {
+	av = _free(av);
+	return rc;
+    }
+
+    con->os++;
+    con->os->next = 0;
+    con->os->stuffed = 0;
+    con->os->nextArg = NULL;
+    con->os->nextCharArg = NULL;
+    con->os->currAlias = NULL;
+    con->os->argb = NULL;
+    con->os->argc = ac;
+    con->os->argv = con->os->argvbuf = av;
+
+    /* Plan finalArgv for the expansion: each arg may record 2 entries. */
+    (void) poptGrowFinalArgv(con, 2 * ac);
+
+    return 0;
+}
+
 /**
  * Return absolute path to executable by searching PATH.
  * @param argv0		name of executable
@@ -598,7 +914,7 @@ findOption(const struct poptOption * opt,
 	case POPT_ARG_INCLUDE_TABLE:	/* Recurse on included sub-tables. */
 	{   const struct poptOption * opt2;
 
-	    poptSubstituteHelpI18N(arg.opt);	/* XXX side effects */
+	    arg.opt = poptSubstituteHelpI18N(arg.opt);
 	    if (arg.ptr == NULL) continue;	/* XXX program error */
 	    opt2 = findOption(arg.opt, longName, longNameLen, shortName, callback,
 			      callbackData, argInfo);
@@ -654,6 +970,10 @@ static const char * findNextArg(/*@special@*/ poptContext con,
     struct optionStackEntry * os = con->os;
     const char * arg;
 
+    /* Stream contexts can't look ahead. */
+    if (con->stream != NULL)
+	return NULL;
+
     do {
 	int i;
 	arg = NULL;
@@ -662,8 +982,9 @@ static const char * findNextArg(/*@special@*/ poptContext con,
 	if (os->argv != NULL)
 	for (i = os->next; i < os->argc; i++) {
 /*@-sizeoftype@*/
-	    if (os->argb && PBM_ISSET(i, os->argb))
-		/*@innercontinue@*/ continue;
+	    /* Skip over a run of already consumed args. */
+	    if (os->argb && (i = PBM_NEXTCLR(i, os->argc, os->argb)) >= os->argc)
+		/*@innerbreak@*/ break;
 	    if (*os->argv[i] == '-')
 		/*@innercontinue@*/ continue;
 	    if (--argx > 0)
@@ -744,6 +1065,8 @@ static void poptStripArg(/*@special@*/ poptContext con, int which)
 	/*@modifies con @*/
 {
 /*@-compdef -sizeoftype -usedef @*/
+    if (con->stream != NULL)	/* stream args aren't in any argv */
+	return;
     if (con->arg_strip == NULL)
 	con->arg_strip = PBM_ALLOC(con->optionStack[0].argc);
     if (con->arg_strip != NULL)		/* XXX can't happen */
@@ -752,146 +1075,930 @@ static void poptStripArg(/*@special@*/ poptContext con, int which)
 /*@=compdef =sizeoftype =usedef @*/
 }
 
-/*@unchecked@*/
-unsigned int _poptBitsN = _POPT_BITS_N;
-/*@unchecked@*/
-unsigned int _poptBitsM = _POPT_BITS_M;
-/*@unchecked@*/
-unsigned int _poptBitsK = _POPT_BITS_K;
-
-/*@-sizeoftype@*/
-static int _poptBitsNew(/*@null@*/ poptBits *bitsp)
-	/*@globals _poptBitsN, _poptBitsM, _poptBitsK @*/
-	/*@modifies *bitsp, _poptBitsN, _poptBitsM, _poptBitsK @*/
+/*@unchecked@*/
+unsigned int _poptBitsN = _POPT_BITS_N;
+/*@unchecked@*/
+unsigned int _poptBitsM = _POPT_BITS_M;
+/*@unchecked@*/
+unsigned int _poptBitsK = _POPT_BITS_K;
+/*@unchecked@*/
+unsigned int _poptBitsFlags = 0;
+
+/* Blocked bit sets: one cache line of bits per member. */
+#define	_POPT_BITS_BLOCK	512U
+#define	_POPT_BITS_BLOCKW	(_POPT_BITS_BLOCK / __PBM_NBITS)
+
+/* Members of poptBitsArgs() and poptSaveBits() are hashed in batches. */
+#define	_POPT_BITS_BATCH	32
+
+#define	_POPT_BITS_LAYOUT	(POPT_BITS_BLOCKED | POPT_BITS_COUNTING | POPT_BITS_XXH64)
+
+/* Counting bit sets: 4 bit saturating counters, 16 to a word. */
+#define	_POPT_NIB_NBITS		(__PBM_NBITS / 4)
+#define	_POPT_NIB_IX(d)		((d) / _POPT_NIB_NBITS)
+#define	_POPT_NIB_MASK(d)	((__pbm_bits) 1 << (4 * ((d) % _POPT_NIB_NBITS)))
+#define	_POPT_NIB_LO		0x1111111111111111ULL	/* low bit of each counter */
+#define	_POPT_NIB_HI		0x8888888888888888ULL	/* high bit of each counter */
+
+/**
+ * Return the low bit of each non-zero counter in a word.
+ * @param w		counter word
+ * @return		low bits of non-zero counters
+ */
+static inline __pbm_bits _poptNibNonzero(__pbm_bits w)
+	/*@*/
+{
+    return (w | (w >> 1) | (w >> 2) | (w >> 3)) & _POPT_NIB_LO;
+}
+
+/**
+ * Return the low bit of each saturated (0xf) counter in a word.
+ * @param w		counter word
+ * @return		low bits of saturated counters
+ */
+static inline __pbm_bits _poptNibFull(__pbm_bits w)
+	/*@*/
+{
+    return w & (w >> 1) & (w >> 2) & (w >> 3) & _POPT_NIB_LO;
+}
+
+/**
+ * Spread the high bit of each counter in a word over the whole counter.
+ * @param h		high bits of counters
+ * @return		all bits of those counters
+ */
+static inline __pbm_bits _poptNibSpread(__pbm_bits h)
+	/*@*/
+{
+    return h | (h >> 1) | (h >> 2) | (h >> 3);
+}
+
+/**
+ * Add the counters of two words, saturating at 0xf.
+ * @param a		counter word
+ * @param b		counter word
+ * @return		counter sums
+ */
+static inline __pbm_bits _poptNibAdd(__pbm_bits a, __pbm_bits b)
+	/*@*/
+{
+    __pbm_bits s = ((a & ~_POPT_NIB_HI) + (b & ~_POPT_NIB_HI))
+		^ ((a ^ b) & _POPT_NIB_HI);
+    __pbm_bits carry = ((a & b) | ((a | b) & ~s)) & _POPT_NIB_HI;
+    return s | _poptNibSpread(carry);
+}
+
+/**
+ * Return the lesser of each pair of counters in two words.
+ * @param a		counter word
+ * @param b		counter word
+ * @return		counter minimums
+ */
+static inline __pbm_bits _poptNibMin(__pbm_bits a, __pbm_bits b)
+	/*@*/
+{
+    __pbm_bits d = ((a | _POPT_NIB_HI) - (b & ~_POPT_NIB_HI))
+		^ ((a ^ ~b) & _POPT_NIB_HI);
+    __pbm_bits lt = _poptNibSpread(((~a & b) | (~(a ^ b) & d)) & _POPT_NIB_HI);
+    return (a & lt) | (b & ~lt);
+}
+
+/**
+ * Increment (or decrement) the counters picked by a mask. A saturated
+ * counter no longer knows its count, and stays saturated.
+ * @param w		counter words
+ * @param mask		low bit of each counter to update
+ * @param n		no. of words
+ * @param decr		decrement (rather than increment)?
+ */
+static inline void _poptNibUpdate(__pbm_bits * w, const __pbm_bits * mask,
+		size_t n, int decr)
+	/*@modifies w @*/
+{
+    size_t i;
+
+    if (decr) {
+	for (i = 0; i < n; i++)
+	    w[i] -= mask[i] & _poptNibNonzero(w[i]) & ~_poptNibFull(w[i]);
+    } else {
+	for (i = 0; i < n; i++)
+	    w[i] += mask[i] & ~_poptNibFull(w[i]);
+    }
+}
+
+/* Odd multipliers, one per probe, spreading a hash over a block's words. */
+/*@unchecked@*/ /*@observer@*/
+static const uint32_t _poptBitsSalt[32] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U,
+    0xfbd4c09dU, 0x5659f377U, 0x91272283U, 0x272cfb91U,
+    0x9258d6afU, 0x92341019U, 0x75a483abU, 0xc2e133f5U,
+    0xb2575c6bU, 0x2bfc3773U, 0x3d80d633U, 0xf745da57U,
+    0x7a4fe2ddU, 0xd150054dU, 0xcd04e2abU, 0x69435cb7U,
+    0xf0652087U, 0x342b2613U, 0x1d25b677U, 0xda971213U,
+    0x467ef83bU, 0x8de2dd31U, 0x650975fdU, 0x19f463dfU,
+};
+
+/**
+ * Allocate an empty bit set, the bits following the header.
+ * The no. of bits (counting: counters) is rounded up to whole words
+ * (blocked: to a power of 2 no. of blocks, 64 byte aligned).
+ * @retval *bitsp	bit set
+ * @param m		no. of bits (counting: counters)
+ * @param k		no. of hash probes per member (1 to 32)
+ * @param flags		bit set layout (POPT_BITS_*)
+ * @return		0 on success, POPT_ERROR_OVERFLOW/POPT_ERROR_MALLOC
+ */
+static int _poptBitsAlloc(/*@out@*/ poptBits * bitsp, double m, unsigned int k,
+		unsigned int flags)
+	/*@modifies *bitsp @*/
+{
+    size_t off = sizeof(struct poptBits_s);
+    size_t nbits = ((flags & POPT_BITS_COUNTING) ? _POPT_NIB_NBITS : __PBM_NBITS);
+    size_t nw;
+    size_t nb;
+    poptBits bits;
+    void * p;
+
+    if (!(m <= (double) (UINT_MAX - _POPT_BITS_BLOCK) / 2.0))
+	return POPT_ERROR_OVERFLOW;
+    if (m < 1.0)
+	m = 1.0;
+    if (flags & POPT_BITS_BLOCKED) {
+	/* Pick a block by masking, its bits on their own cache line(s). */
+	size_t n = 1;
+	while ((double) (n * _POPT_BITS_BLOCKW * nbits) < m)
+	    n <<= 1;
+	nw = n * _POPT_BITS_BLOCKW;
+	off = (off + _POPT_BITS_BLOCK/8 - 1) & ~((size_t) _POPT_BITS_BLOCK/8 - 1);
+    } else
+	nw = ((size_t) ceil(m) - 1) / nbits + 1;
+    nb = off + nw * sizeof(__pbm_bits);
+
+#if defined(HAVE_POSIX_MEMALIGN)
+    if (flags & POPT_BITS_BLOCKED) {
+	if (posix_memalign(&p, _POPT_BITS_BLOCK/8, nb) != 0)
+	    p = NULL;
+    } else
+#endif
+	p = malloc(nb);
+    if (p == NULL)
+	return POPT_ERROR_MALLOC;
+    memset(p, 0, nb);
+
+    bits = p;
+    bits->m = (unsigned int) (nw * nbits);
+    bits->k = k;
+    bits->flags = flags;
+    bits->nw = (unsigned int) nw;
+    bits->bits = (__pbm_bits *) ((char *) p + off);
+    *bitsp = bits;
+    return 0;
+}
+
+int poptBitsNew(poptBits * bitsp, unsigned int n, double fpr,
+		unsigned int flags)
+{
+    double m;
+    double k;
+
+    if (bitsp == NULL)
+	return POPT_ERROR_NULLARG;
+    if (!(fpr > 0.0 && fpr < 1.0))
+	return POPT_ERROR_BADNUMBER;
+    if (n == 0)
+	n = 1;
+
+    /* Optimal geometry: m = -n ln(p) / ln(2)^2 bits, k = (m/n) ln(2). */
+    m = -(double) n * log(fpr) / (M_LN2 * M_LN2);
+    k = floor((m / (double) n) * M_LN2 + 0.5);
+    if (k < 1.0)
+	k = 1.0;
+    if (k > 32.0)
+	k = 32.0;
+    return _poptBitsAlloc(bitsp, m, (unsigned int) k,
+			flags & _POPT_BITS_LAYOUT);
+}
+
+poptBits poptBitsFree(poptBits bits)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+    if (bits != NULL && (bits->flags & POPT_BITS_RDONLY))
+	(void) munmap((char *) __PBM_BITS(bits) - sizeof(struct poptBitsHeader_s),
+		sizeof(struct poptBitsHeader_s) + bits->nw * sizeof(__pbm_bits));
+#endif
+    return _free(bits);
+}
+
+/**
+ * Allocate a bit set lazily, with the _poptBits* geometry.
+ * @retval *bitsp	bit set (if NULL)
+ * @return		0 on success
+ */
+static int _poptBitsNew(/*@null@*/ poptBits *bitsp)
+	/*@globals _poptBitsN, _poptBitsM, _poptBitsK, _poptBitsFlags @*/
+	/*@modifies *bitsp @*/
+{
+    unsigned int m = (_poptBitsN == 0U ? _POPT_BITS_M
+		: (_poptBitsM != 0U ? _poptBitsM : (3U * _poptBitsN) / 2U));
+    unsigned int k = ((_poptBitsK == 0U || _poptBitsK > 32U)
+		? _POPT_BITS_K : _poptBitsK);
+
+    if (bitsp == NULL)
+	return POPT_ERROR_NULLARG;
+
+    /* XXX handle negated initialization. */
+    if (*bitsp != NULL)
+	return 0;
+/*@-nullstate@*/
+    return _poptBitsAlloc(bitsp, (double) m, k, _poptBitsFlags & _POPT_BITS_LAYOUT);
+/*@=nullstate@*/
+}
+
+/**
+ * Find the block of a member of a blocked bit set.
+ * @param bits		bit set
+ * @param h0		1st hash of member
+ * @return		block of member
+ */
+static inline __pbm_bits * _poptBitsBlockAt(poptBits bits, uint32_t h0)
+	/*@*/
+{
+    return __PBM_BITS(bits)
+	+ (size_t) (h0 & (bits->nw / _POPT_BITS_BLOCKW - 1)) * _POPT_BITS_BLOCKW;
+}
+
+/**
+ * Find the block of a member of a blocked bit set, and its probe mask.
+ * h0 picks the block. Probe i sets one bit of word (i % 8) of the block,
+ * chosen by the top 6 bits of h1 * salt[i] (counting: the low bit of
+ * one counter, by the top 4 bits). The mask has no data dependent
+ * indexing, so the loops over it vectorize.
+ * @param bits		bit set
+ * @param h0		1st hash of member
+ * @param h1		2nd hash of member
+ * @retval mask		probe mask (_POPT_BITS_BLOCKW words)
+ * @return		block of member
+ */
+static __pbm_bits * _poptBitsBlock(poptBits bits, uint32_t h0, uint32_t h1,
+		/*@out@*/ __pbm_bits * mask)
+	/*@modifies mask @*/
+{
+    size_t k = bits->k;
+    unsigned int w = ((bits->flags & POPT_BITS_COUNTING) ? 2 : 0);
+    size_t i, j;
+
+    for (i = 0; i < _POPT_BITS_BLOCKW; i++)
+	mask[i] = 0;
+    for (j = 0; j + _POPT_BITS_BLOCKW <= k; j += _POPT_BITS_BLOCKW) {
+	for (i = 0; i < _POPT_BITS_BLOCKW; i++)
+	    mask[i] |= (__pbm_bits)1 << (((h1 * _poptBitsSalt[j + i]) >> (26 + w)) << w);
+    }
+    for (i = 0; j + i < k; i++)
+	mask[i] |= (__pbm_bits)1 << (((h1 * _poptBitsSalt[j + i]) >> (26 + w)) << w);
+    return _poptBitsBlockAt(bits, h0);
+}
+
+/**
+ * Hash a bit set member with the set's hash.
+ * @param bits		bit set
+ * @param s		member
+ * @param ns		length of member
+ * @retval *h0		1st hash of member
+ * @retval *h1		2nd hash of member
+ */
+static inline void _poptBitsHash(const poptBits bits, const char * s,
+		size_t ns, uint32_t * h0, uint32_t * h1)
+	/*@modifies *h0, *h1 @*/
+{
+    if (bits->flags & POPT_BITS_XXH64)
+	poptXxh64pair(s, ns, h0, h1);
+    else
+	poptJlu32lpair(s, ns, h0, h1);
+}
+
+/**
+ * Do two bit sets have the same geometry?
+ * @param a		1st bit set
+ * @param b		2nd bit set
+ * @return		1 if same, 0 otherwise
+ */
+static inline int _poptBitsSame(const poptBits a, const poptBits b)
+	/*@*/
+{
+    return (a->m == b->m && a->k == b->k
+	 && (a->flags & _POPT_BITS_LAYOUT) == (b->flags & _POPT_BITS_LAYOUT));
+}
+
+/**
+ * Add a member, given its hashes, to a bit set.
+ * @param bits		bit set
+ * @param h0		1st hash of member
+ * @param h1		2nd hash of member
+ */
+static void _poptBitsAddHash(poptBits bits, uint32_t h0, uint32_t h1)
+	/*@modifies bits @*/
+{
+    uint32_t m;
+    size_t k;
+    size_t i;
+
+    if (bits->flags & POPT_BITS_BLOCKED) {
+	__pbm_bits mask[_POPT_BITS_BLOCKW];
+	__pbm_bits * blk = _poptBitsBlock(bits, h0, h1, mask);
+	if (bits->flags & POPT_BITS_COUNTING)
+	    _poptNibUpdate(blk, mask, _POPT_BITS_BLOCKW, 0);
+	else {
+	    for (i = 0; i < _POPT_BITS_BLOCKW; i++)
+		blk[i] |= mask[i];
+	}
+	return;
+    }
+
+    m = bits->m;
+    k = bits->k;
+    for (i = 0; i < k; i++) {
+        uint32_t h = h0 + i * h1;
+        uint32_t ix = (h % m);
+	if (bits->flags & POPT_BITS_COUNTING) {
+	    __pbm_bits mask = _POPT_NIB_MASK(ix);
+	    _poptNibUpdate(__PBM_BITS(bits) + _POPT_NIB_IX(ix), &mask, 1, 0);
+	} else
+	    PBM_SET(ix, bits);
+    }
+}
+
+/**
+ * Check a member, given its hashes, in a bit set.
+ * @param bits		bit set
+ * @param h0		1st hash of member
+ * @param h1		2nd hash of member
+ * @return		1 if member is (probably) in the set, 0 otherwise
+ */
+static int _poptBitsChkHash(poptBits bits, uint32_t h0, uint32_t h1)
+	/*@*/
+{
+    uint32_t m;
+    size_t k;
+    size_t i;
+    int rc = 1;
+
+    if (bits->flags & POPT_BITS_BLOCKED) {
+	__pbm_bits mask[_POPT_BITS_BLOCKW];
+	__pbm_bits * blk = _poptBitsBlock(bits, h0, h1, mask);
+	__pbm_bits miss = 0;
+	if (bits->flags & POPT_BITS_COUNTING) {
+	    for (i = 0; i < _POPT_BITS_BLOCKW; i++)
+		miss |= mask[i] & ~_poptNibNonzero(blk[i]);
+	} else {
+	    for (i = 0; i < _POPT_BITS_BLOCKW; i++)
+		miss |= mask[i] & ~blk[i];
+	}
+	return (miss == 0 ? 1 : 0);
+    }
+
+    m = bits->m;
+    k = bits->k;
+    for (i = 0; i < k; i++) {
+        uint32_t h = h0 + i * h1;
+        uint32_t ix = (h % m);
+	if (bits->flags & POPT_BITS_COUNTING) {
+	    if (__PBM_BITS(bits)[_POPT_NIB_IX(ix)] & (_POPT_NIB_MASK(ix) * 0xfU))
+		continue;
+	} else if (PBM_ISSET(ix, bits))
+	    continue;
+        rc = 0;
+        break;
+    }
+    return rc;
+}
+
+/**
+ * Delete a member, given its hashes, from a bit set.
+ * @param bits		bit set
+ * @param h0		1st hash of member
+ * @param h1		2nd hash of member
+ */
+static void _poptBitsDelHash(poptBits bits, uint32_t h0, uint32_t h1)
+	/*@modifies bits @*/
+{
+    uint32_t m;
+    size_t k;
+    size_t i;
+
+    if (bits->flags & POPT_BITS_BLOCKED) {
+	__pbm_bits mask[_POPT_BITS_BLOCKW];
+	__pbm_bits * blk = _poptBitsBlock(bits, h0, h1, mask);
+	if (bits->flags & POPT_BITS_COUNTING)
+	    _poptNibUpdate(blk, mask, _POPT_BITS_BLOCKW, 1);
+	else {
+	    for (i = 0; i < _POPT_BITS_BLOCKW; i++)
+		blk[i] &= ~mask[i];
+	}
+	return;
+    }
+
+    m = bits->m;
+    k = bits->k;
+    for (i = 0; i < k; i++) {
+        uint32_t h = h0 + i * h1;
+        uint32_t ix = (h % m);
+	if (bits->flags & POPT_BITS_COUNTING) {
+	    __pbm_bits mask = _POPT_NIB_MASK(ix);
+	    _poptNibUpdate(__PBM_BITS(bits) + _POPT_NIB_IX(ix), &mask, 1, 1);
+	} else
+	    PBM_CLR(ix, bits);
+    }
+}
+
+/**
+ * Add (or, if negated, check and delete) a batch of members.
+ * The members are hashed together (see jlu32lpairN()), and the blocks of
+ * a blocked set are prefetched before any is touched, so the cache misses
+ * of the batch overlap.
+ * @param bits		bit set
+ * @param n		no. of members (at most _POPT_BITS_BATCH)
+ * @param keys		members
+ * @param sizes		lengths of members
+ * @param negate	bit i set: delete member i, if present
+ */
+static void _poptBitsUpdateN(poptBits bits, size_t n,
+		const char ** keys, const size_t * sizes, uint32_t negate)
+	/*@modifies bits @*/
+{
+    uint32_t h0[_POPT_BITS_BATCH];
+    uint32_t h1[_POPT_BITS_BATCH];
+    size_t i;
+
+    for (i = 0; i < n; i++)
+	h0[i] = h1[i] = 0;
+    if (bits->flags & POPT_BITS_XXH64) {
+	for (i = 0; i < n; i++)
+	    poptXxh64pair(keys[i], sizes[i], &h0[i], &h1[i]);
+    } else
+	poptJlu32lpairN(n, (const void * const *) keys, sizes, h0, h1);
+
+#if defined(__GNUC__)
+    if (bits->flags & POPT_BITS_BLOCKED) {
+	for (i = 0; i < n; i++)
+	    __builtin_prefetch(_poptBitsBlockAt(bits, h0[i]), 1);
+    }
+#endif
+
+    for (i = 0; i < n; i++) {
+	if (!(negate & (1U << i)))
+	    _poptBitsAddHash(bits, h0[i], h1[i]);
+	else if (_poptBitsChkHash(bits, h0[i], h1[i]))
+	    _poptBitsDelHash(bits, h0[i], h1[i]);
+    }
+}
+
+int poptBitsAdd(poptBits bits, const char * s)
+{
+    size_t ns = (s ? strlen(s) : 0);
+    uint32_t h0 = 0;
+    uint32_t h1 = 0;
+
+    if (bits == NULL || ns == 0)
+	return POPT_ERROR_NULLARG;
+    if (bits->flags & POPT_BITS_RDONLY)
+	return POPT_ERROR_BADOPERATION;
+
+    _poptBitsHash(bits, s, ns, &h0, &h1);
+    _poptBitsAddHash(bits, h0, h1);
+    return 0;
+}
+
+int poptBitsChk(poptBits bits, const char * s)
+{
+    size_t ns = (s ? strlen(s) : 0);
+    uint32_t h0 = 0;
+    uint32_t h1 = 0;
+
+    if (bits == NULL || ns == 0)
+	return POPT_ERROR_NULLARG;
+
+    _poptBitsHash(bits, s, ns, &h0, &h1);
+    return _poptBitsChkHash(bits, h0, h1);
+}
+
+int poptBitsClr(poptBits bits)
+{
+    if (bits == NULL)
+	return POPT_ERROR_NULLARG;
+    if (bits->flags & POPT_BITS_RDONLY)
+	return POPT_ERROR_BADOPERATION;
+    memset(__PBM_BITS(bits), 0, bits->nw * sizeof(__pbm_bits));
+    return 0;
+}
+
+int poptBitsDel(poptBits bits, const char * s)
+{
+    size_t ns = (s ? strlen(s) : 0);
+    uint32_t h0 = 0;
+    uint32_t h1 = 0;
+
+    if (bits == NULL || ns == 0)
+	return POPT_ERROR_NULLARG;
+    if (bits->flags & POPT_BITS_RDONLY)
+	return POPT_ERROR_BADOPERATION;
+
+    _poptBitsHash(bits, s, ns, &h0, &h1);
+    _poptBitsDelHash(bits, h0, h1);
+    return 0;
+}
+
+/**
+ * AND (or OR) the words of b into a, a vector of words at a time.
+ * @param a		bit set words
+ * @param b		bit set words
+ * @param nw		no. of words
+ * @param intersect	AND (rather than OR) the words?
+ * @return		non-zero if any bit is set in the result
+ */
+static __pbm_bits _poptBitsMerge(__pbm_bits * a, const __pbm_bits * b,
+		size_t nw, int intersect)
+	/*@modifies a @*/
+{
+    __pbm_bits rc = 0;
+    size_t i = 0;
+
+#if defined(__PBM_VECW)
+    {	__pbm_vec vrc = { 0 };
+	size_t j;
+	if (intersect) {
+	    for (; i + __PBM_VECW <= nw; i += __PBM_VECW) {
+		__pbm_vec * va = (__pbm_vec *) (a + i);
+		*va &= *(const __pbm_vec *) (b + i);
+		vrc |= *va;
+	    }
+	} else {
+	    for (; i + __PBM_VECW <= nw; i += __PBM_VECW) {
+		__pbm_vec * va = (__pbm_vec *) (a + i);
+		*va |= *(const __pbm_vec *) (b + i);
+		vrc |= *va;
+	    }
+	}
+	for (j = 0; j < __PBM_VECW; j++)
+	    rc |= vrc[j];
+    }
+#endif
+    for (; i < nw; i++) {
+	a[i] = (intersect ? (a[i] & b[i]) : (a[i] | b[i]));
+	rc |= a[i];
+    }
+    return rc;
+}
+
+/**
+ * Add (or take the minimum of) the counters of b and a.
+ * @param a		counter words
+ * @param b		counter words
+ * @param nw		no. of words
+ * @param intersect	take the minimum (rather than add)?
+ * @return		non-zero if any counter is non-zero in the result
+ */
+static __pbm_bits _poptBitsMergeCounts(__pbm_bits * a, const __pbm_bits * b,
+		size_t nw, int intersect)
+	/*@modifies a @*/
 {
-    if (bitsp == NULL)
-	return POPT_ERROR_NULLARG;
+    __pbm_bits rc = 0;
+    size_t i;
 
-    /* XXX handle negated initialization. */
-    if (*bitsp == NULL) {
-	if (_poptBitsN == 0) {
-	    _poptBitsN = _POPT_BITS_N;
-	    _poptBitsM = _POPT_BITS_M;
+    if (intersect) {
+	for (i = 0; i < nw; i++) {
+	    a[i] = _poptNibMin(a[i], b[i]);
+	    rc |= a[i];
+	}
+    } else {
+	for (i = 0; i < nw; i++) {
+	    a[i] = _poptNibAdd(a[i], b[i]);
+	    rc |= a[i];
 	}
-	if (_poptBitsM == 0U) _poptBitsM = (3 * _poptBitsN) / 2;
-	if (_poptBitsK == 0U || _poptBitsK > 32U) _poptBitsK = _POPT_BITS_K;
-	*bitsp = PBM_ALLOC(_poptBitsM-1);
     }
-/*@-nullstate@*/
-    return 0;
-/*@=nullstate@*/
+    return rc;
 }
 
-int poptBitsAdd(poptBits bits, const char * s)
+/**
+ * Merge bit set b into *ap, allocating an empty *ap like b if NULL.
+ * @retval *ap		bit set
+ * @param b		bit set
+ * @param intersect	AND (rather than OR) the sets?
+ * @return		1 if *ap is non-empty, 0 if empty, or POPT_ERROR_*
+ */
+static int _poptBitsMergeSet(/*@null@*/ poptBits *ap,
+		/*@null@*/ const poptBits b, int intersect)
+	/*@modifies *ap @*/
 {
-    size_t ns = (s ? strlen(s) : 0);
-    uint32_t h0 = 0;
-    uint32_t h1 = 0;
+    int rc;
 
-    if (bits == NULL || ns == 0)
+    if (ap == NULL || b == NULL)
 	return POPT_ERROR_NULLARG;
+    if (*ap == NULL && (rc = _poptBitsAlloc(ap, (double) b->m, b->k,
+				b->flags & _POPT_BITS_LAYOUT)) != 0)
+	return rc;
+    if (!_poptBitsSame(*ap, b) || ((*ap)->flags & POPT_BITS_RDONLY))
+	return POPT_ERROR_BADOPERATION;
+    if (b->flags & POPT_BITS_COUNTING)
+	return (_poptBitsMergeCounts(__PBM_BITS(*ap), __PBM_BITS(b), b->nw,
+				intersect) ? 1 : 0);
+    return (_poptBitsMerge(__PBM_BITS(*ap), __PBM_BITS(b), b->nw, intersect)
+		? 1 : 0);
+}
 
-    poptJlu32lpair(s, ns, &h0, &h1);
+int poptBitsIntersect(poptBits *ap, const poptBits b)
+{
+    return _poptBitsMergeSet(ap, b, 1);
+}
 
-    for (ns = 0; ns < (size_t)_poptBitsK; ns++) {
-        uint32_t h = h0 + ns * h1;
-        uint32_t ix = (h % _poptBitsM);
-        PBM_SET(ix, bits);
-    }
-    return 0;
+int poptBitsUnion(poptBits *ap, const poptBits b)
+{
+    return _poptBitsMergeSet(ap, b, 0);
 }
 
-int poptBitsChk(poptBits bits, const char * s)
+/**
+ * Return the no. of bits set in a (or in a OR b).
+ * @param a		bit set words
+ * @param b		bit set words (or NULL)
+ * @param nw		no. of words
+ * @param counting	count non-zero counters (rather than bits)?
+ * @return		population count
+ */
+static size_t _poptBitsPopcount(const __pbm_bits * a,
+		/*@null@*/ const __pbm_bits * b, size_t nw, int counting)
+	/*@*/
 {
-    size_t ns = (s ? strlen(s) : 0);
-    uint32_t h0 = 0;
-    uint32_t h1 = 0;
-    int rc = 1;
+    size_t n = 0;
+    size_t i;
 
-    if (bits == NULL || ns == 0)
-	return POPT_ERROR_NULLARG;
+    if (counting) {
+	for (i = 0; i < nw; i++)
+	    n += __pbmPopcount(_poptNibNonzero(a[i] | (b ? b[i] : 0)));
+    } else if (b == NULL) {
+	for (i = 0; i < nw; i++)
+	    n += __pbmPopcount(a[i]);
+    } else {
+	for (i = 0; i < nw; i++)
+	    n += __pbmPopcount(a[i] | b[i]);
+    }
+    return n;
+}
 
-    poptJlu32lpair(s, ns, &h0, &h1);
+/**
+ * Estimate the no. of members that set x of the m bits of a bit set,
+ * n = -(m/k) ln(1 - x/m). A full set is taken to be one bit short of full.
+ * @param bits		bit set
+ * @param x		population count
+ * @return		estimated no. of members
+ */
+static double _poptBitsEstimate(const poptBits bits, size_t x)
+	/*@*/
+{
+    double m = (double) bits->m;
+    double k = (double) bits->k;
 
-    for (ns = 0; ns < (size_t)_poptBitsK; ns++) {
-        uint32_t h = h0 + ns * h1;
-        uint32_t ix = (h % _poptBitsM);
-        if (PBM_ISSET(ix, bits))
-            continue;
-        rc = 0;
-        break;
-    }
-    return rc;
+    if ((double) x >= m)
+	x = (size_t) m - 1;
+    return -(m / k) * log(1.0 - (double) x / m);
 }
 
-int poptBitsClr(poptBits bits)
+int poptBitsCount(const poptBits bits)
 {
-    static size_t nbw = (__PBM_NBITS/8);
-    size_t nw = (__PBM_IX(_poptBitsM-1) + 1);
+    double n;
 
     if (bits == NULL)
 	return POPT_ERROR_NULLARG;
-    memset(bits, 0, nw * nbw);
-    return 0;
+    n = _poptBitsEstimate(bits,
+		_poptBitsPopcount(__PBM_BITS(bits), NULL, bits->nw,
+				bits->flags & POPT_BITS_COUNTING));
+    return (n < (double) INT_MAX ? (int) (n + 0.5) : INT_MAX);
 }
 
-int poptBitsDel(poptBits bits, const char * s)
+int poptBitsJaccard(const poptBits a, const poptBits b, double * jp)
 {
-    size_t ns = (s ? strlen(s) : 0);
-    uint32_t h0 = 0;
-    uint32_t h1 = 0;
+    double na, nb, nab;
+    int counting;
 
-    if (bits == NULL || ns == 0)
+    if (a == NULL || b == NULL || jp == NULL)
 	return POPT_ERROR_NULLARG;
+    if (!_poptBitsSame(a, b))
+	return POPT_ERROR_BADOPERATION;
+
+    counting = (a->flags & POPT_BITS_COUNTING);
+    na = _poptBitsEstimate(a,
+		_poptBitsPopcount(__PBM_BITS(a), NULL, a->nw, counting));
+    nb = _poptBitsEstimate(b,
+		_poptBitsPopcount(__PBM_BITS(b), NULL, b->nw, counting));
+    nab = _poptBitsEstimate(a,
+		_poptBitsPopcount(__PBM_BITS(a), __PBM_BITS(b), a->nw, counting));
+
+    /* |a AND b| = |a| + |b| - |a OR b|. Two empty sets are the same set. */
+    if (nab <= 0.0)
+	*jp = 1.0;
+    else
+	*jp = (na + nb - nab) / nab;
+    if (*jp < 0.0)
+	*jp = 0.0;
+    if (*jp > 1.0)
+	*jp = 1.0;
+    return 0;
+}
 
-    poptJlu32lpair(s, ns, &h0, &h1);
+/**
+ * Write all of a buffer to a file.
+ * @param fdno		file descriptor
+ * @param b		buffer
+ * @param nb		no. of bytes
+ * @return		0 on success, POPT_ERROR_ERRNO on failure
+ */
+static int _poptBitsWrite(int fdno, const void * b, size_t nb)
+	/*@globals errno, fileSystem @*/
+	/*@modifies errno, fileSystem @*/
+{
+    const char * s = b;
 
-    for (ns = 0; ns < (size_t)_poptBitsK; ns++) {
-        uint32_t h = h0 + ns * h1;
-        uint32_t ix = (h % _poptBitsM);
-        PBM_CLR(ix, bits);
+    while (nb > 0) {
+	ssize_t nw = write(fdno, s, nb);
+	if (nw < 0 && errno == EINTR)
+	    continue;
+	if (nw <= 0)
+	    return POPT_ERROR_ERRNO;
+	s += nw;
+	nb -= (size_t) nw;
     }
     return 0;
 }
 
-int poptBitsIntersect(poptBits *ap, const poptBits b)
+/**
+ * Read all of a buffer from a file.
+ * @param fdno		file descriptor
+ * @retval b		buffer
+ * @param nb		no. of bytes
+ * @return		0 on success, POPT_ERROR_ERRNO on failure,
+ *			POPT_ERROR_BADCONFIG if the file ends first
+ */
+static int _poptBitsRead(int fdno, /*@out@*/ void * b, size_t nb)
+	/*@globals errno, fileSystem @*/
+	/*@modifies b, errno, fileSystem @*/
 {
-    __pbm_bits *abits;
-    __pbm_bits *bbits;
-    __pbm_bits rc = 0;
-    size_t nw = (__PBM_IX(_poptBitsM-1) + 1);
-    size_t i;
+    char * t = b;
+
+    while (nb > 0) {
+	ssize_t nr = read(fdno, t, nb);
+	if (nr < 0 && errno == EINTR)
+	    continue;
+	if (nr < 0)
+	    return POPT_ERROR_ERRNO;
+	if (nr == 0)
+	    return POPT_ERROR_BADCONFIG;
+	t += nr;
+	nb -= (size_t) nr;
+    }
+    return 0;
+}
+
+/**
+ * Check a bit set file header, and that the file holds its words.
+ * The geometry is checked as strictly as poptBitsNew() makes it, since
+ * the words of a mapped file are used as they are.
+ * @param hdr		bit set file header
+ * @param size		file size
+ * @return		0 if sane, POPT_ERROR_BADCONFIG otherwise
+ */
+static int _poptBitsHeaderCheck(const struct poptBitsHeader_s * hdr,
+		uint64_t size)
+	/*@*/
+{
+    uint64_t nbits = ((hdr->flags & POPT_BITS_COUNTING) ? _POPT_NIB_NBITS : __PBM_NBITS);
+    uint32_t nblocks = hdr->nw / _POPT_BITS_BLOCKW;
+
+    if (memcmp(hdr->magic, POPT_BITS_MAGIC, sizeof(hdr->magic))
+     || hdr->version != POPT_BITS_VERSION
+     || hdr->order != POPT_BITS_ORDER
+     || hdr->wordsize != (uint32_t) sizeof(__pbm_bits)
+     || hdr->hash > POPT_BITS_HASH_XXH64
+     || (hdr->flags & ~(POPT_BITS_BLOCKED | POPT_BITS_COUNTING))
+     || hdr->k < 1 || hdr->k > 32
+     || hdr->nw == 0 || (uint64_t) hdr->nw * nbits != hdr->m)
+	return POPT_ERROR_BADCONFIG;
+    /* Blocks are picked by masking. */
+    if ((hdr->flags & POPT_BITS_BLOCKED)
+     && ((hdr->nw % _POPT_BITS_BLOCKW) || (nblocks & (nblocks - 1))))
+	return POPT_ERROR_BADCONFIG;
+    if (size != sizeof(*hdr) + (uint64_t) hdr->nw * sizeof(__pbm_bits))
+	return POPT_ERROR_BADCONFIG;
+    return 0;
+}
+
+int poptBitsSave(const poptBits bits, const char * fn)
+{
+    struct poptBitsHeader_s hdr;
+    char * tfn;
+    int fdno;
+    int rc;
 
-    if (ap == NULL || b == NULL || _poptBitsNew(ap))
+    if (bits == NULL || fn == NULL || *fn == '\0')
 	return POPT_ERROR_NULLARG;
-    abits = __PBM_BITS(*ap);
-    bbits = __PBM_BITS(b);
 
-    for (i = 0; i < nw; i++) {
-        abits[i] &= bbits[i];
-	rc |= abits[i];
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, POPT_BITS_MAGIC, sizeof(hdr.magic));
+    hdr.version = POPT_BITS_VERSION;
+    hdr.order = POPT_BITS_ORDER;
+    hdr.wordsize = (uint32_t) sizeof(__pbm_bits);
+    hdr.hash = ((bits->flags & POPT_BITS_XXH64)
+		? POPT_BITS_HASH_XXH64 : POPT_BITS_HASH_JLU32);
+    hdr.flags = bits->flags & (POPT_BITS_BLOCKED | POPT_BITS_COUNTING);
+    hdr.k = bits->k;
+    hdr.m = bits->m;
+    hdr.nw = bits->nw;
+
+    if ((tfn = malloc(strlen(fn) + sizeof(".tmp"))) == NULL)
+	return POPT_ERROR_MALLOC;
+    (void) stpcpy(stpcpy(tfn, fn), ".tmp");
+
+    if ((fdno = open(tfn, O_WRONLY|O_CREAT|O_EXCL, 0666)) < 0) {
+	tfn = _free(tfn);
+	return POPT_ERROR_ERRNO;
+    }
+    rc = _poptBitsWrite(fdno, &hdr, sizeof(hdr));
+    if (rc == 0)
+	rc = _poptBitsWrite(fdno, __PBM_BITS(bits),
+			bits->nw * sizeof(__pbm_bits));
+    if (close(fdno) != 0 && rc == 0)
+	rc = POPT_ERROR_ERRNO;
+    /* Replace fn, rather than truncate pages that may be mapped. */
+    if (rc == 0 && rename(tfn, fn) != 0)
+	rc = POPT_ERROR_ERRNO;
+    if (rc != 0) {
+	int xx = errno;
+	(void) unlink(tfn);
+	errno = xx;
     }
-    return (rc ? 1 : 0);
+    tfn = _free(tfn);
+    return rc;
 }
 
-int poptBitsUnion(poptBits *ap, const poptBits b)
+int poptBitsLoad(poptBits * bitsp, const char * fn)
 {
-    __pbm_bits *abits;
-    __pbm_bits *bbits;
-    __pbm_bits rc = 0;
-    size_t nw = (__PBM_IX(_poptBitsM-1) + 1);
-    size_t i;
+    struct poptBitsHeader_s hdr;
+    struct stat sb;
+    poptBits bits = NULL;
+    unsigned int flags;
+    size_t nb;
+    int fdno;
+    int rc;
 
-    if (ap == NULL || b == NULL || _poptBitsNew(ap))
+    if (bitsp == NULL || fn == NULL)
 	return POPT_ERROR_NULLARG;
-    abits = __PBM_BITS(*ap);
-    bbits = __PBM_BITS(b);
+    *bitsp = NULL;
+
+    if ((fdno = open(fn, O_RDONLY)) < 0)
+	return POPT_ERROR_ERRNO;
+    if (fstat(fdno, &sb) != 0)
+	rc = POPT_ERROR_ERRNO;
+    else if ((rc = _poptBitsRead(fdno, &hdr, sizeof(hdr))) == 0)
+	rc = _poptBitsHeaderCheck(&hdr, (uint64_t) sb.st_size);
+    if (rc != 0)
+	goto exit;
 
-    for (i = 0; i < nw; i++) {
-        abits[i] |= bbits[i];
-	rc |= abits[i];
+    flags = hdr.flags;
+    if (hdr.hash == POPT_BITS_HASH_XXH64)
+	flags |= POPT_BITS_XXH64;
+    nb = sizeof(hdr) + (size_t) hdr.nw * sizeof(__pbm_bits);
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+    {	/* Share the words of the file, rather than copy them. */
+	void * p = mmap(NULL, nb, PROT_READ, MAP_SHARED, fdno, 0);
+	if (p != MAP_FAILED) {
+	    if ((bits = malloc(sizeof(*bits))) == NULL) {
+		(void) munmap(p, nb);
+		rc = POPT_ERROR_MALLOC;
+		goto exit;
+	    }
+	    bits->m = hdr.m;
+	    bits->k = hdr.k;
+	    bits->flags = flags | POPT_BITS_RDONLY;
+	    bits->nw = hdr.nw;
+	    bits->bits = (__pbm_bits *) ((char *) p + sizeof(hdr));
+	    goto exit;
+	}
     }
-    return (rc ? 1 : 0);
+#endif
+
+    /* No mmap(): read the words into a set of the same geometry. */
+    if ((rc = _poptBitsAlloc(&bits, (double) hdr.m, hdr.k, flags)) != 0)
+	goto exit;
+    if (bits->nw != hdr.nw)
+	rc = POPT_ERROR_BADCONFIG;
+    else
+	rc = _poptBitsRead(fdno, __PBM_BITS(bits), nb - sizeof(hdr));
+    if (rc != 0)
+	bits = poptBitsFree(bits);
+
+exit:
+    (void) close(fdno);
+    *bitsp = bits;
+    return rc;
 }
 
 int poptBitsArgs(poptContext con, poptBits *ap)
@@ -902,13 +2009,26 @@ int poptBitsArgs(poptContext con, poptBits *ap)
     if (con == NULL || ap == NULL || _poptBitsNew(ap) ||
 	con->leftovers == NULL || con->numLeftovers == con->nextLeftover)
 	return POPT_ERROR_NULLARG;
+    if ((*ap)->flags & POPT_BITS_RDONLY)
+	return POPT_ERROR_BADOPERATION;
 
     /* some apps like [like RPM ;-) ] need this NULL terminated */
     con->leftovers[con->numLeftovers] = NULL;
 
-    for (av = con->leftovers + con->nextLeftover; *av != NULL; av++) {
-	if ((rc = poptBitsAdd(*ap, *av)) != 0)
-	    break;
+    av = con->leftovers + con->nextLeftover;
+    while (*av != NULL && rc == 0) {
+	const char * keys[_POPT_BITS_BATCH];
+	size_t sizes[_POPT_BITS_BATCH];
+	size_t n;
+
+	for (n = 0; n < _POPT_BITS_BATCH && *av != NULL; n++, av++) {
+	    keys[n] = *av;
+	    if ((sizes[n] = strlen(*av)) == 0) {
+		rc = POPT_ERROR_NULLARG;
+		break;
+	    }
+	}
+	_poptBitsUpdateN(*ap, n, keys, sizes, 0);
     }
 /*@-nullstate@*/
     return rc;
@@ -924,26 +2044,38 @@ int poptSaveBits(poptBits * bitsp,
 
     if (bitsp == NULL || s == NULL || *s == '\0' || _poptBitsNew(bitsp))
 	return POPT_ERROR_NULLARG;
+    if ((*bitsp)->flags & POPT_BITS_RDONLY)
+	return POPT_ERROR_BADOPERATION;
 
-    /* Parse comma separated attributes. */
     te = tbuf = xstrdup(s);
-    while ((t = te) != NULL && *t) {
-	while (*te != '\0' && *te != ',')
-	    te++;
-	if (*te != '\0')
-	    *te++ = '\0';
-	/* XXX Ignore empty strings. */
-	if (*t == '\0')
-	    continue;
-	/* XXX Permit negated attributes. caveat emptor: false negatives. */
-	if (*t == '!') {
-	    t++;
-	    if ((rc = poptBitsChk(*bitsp, t)) > 0)
-		rc = poptBitsDel(*bitsp, t);
-	} else
-	    rc = poptBitsAdd(*bitsp, t);
-	if (rc)
-	    break;
+    while (te != NULL && *te != '\0' && rc == 0) {
+	const char * keys[_POPT_BITS_BATCH];
+	size_t sizes[_POPT_BITS_BATCH];
+	uint32_t negate = 0;
+	size_t n = 0;
+
+	/* Parse a batch of comma separated attributes. */
+	while (n < _POPT_BITS_BATCH && *(t = te) != '\0') {
+	    while (*te != '\0' && *te != ',')
+		te++;
+	    if (*te != '\0')
+		*te++ = '\0';
+	    /* XXX Ignore empty strings. */
+	    if (*t == '\0')
+		continue;
+	    /* XXX Permit negated attributes. caveat emptor: false negatives,
+	     * unless the set is counting (POPT_BITS_COUNTING). */
+	    if (*t == '!') {
+		if (*++t == '\0') {
+		    rc = POPT_ERROR_NULLARG;
+		    break;
+		}
+		negate |= (1U << n);
+	    }
+	    keys[n] = t;
+	    sizes[n++] = strlen(t);
+	}
+	_poptBitsUpdateN(*bitsp, n, keys, sizes, negate);
     }
     tbuf = _free(tbuf);
     return rc;
@@ -972,6 +2104,78 @@ int poptSaveString(const char *** argvp,
 /*@=unqualifiedtrans =nullstate@*/
 }
 
+/**
+ * Append a string to a POPT_ARG_ARGV target vector.
+ * Unlike poptSaveString(), the vector length and capacity are kept in the
+ * context, so collecting N arguments costs O(N) rather than O(N^2).
+ * @param con		context
+ * @retval *argvp	argv array
+ * @param val		string arg to append (malloc'd copy)
+ * @return		0 on success, POPT_ERROR_NULLARG/POPT_ERROR_MALLOC
+ */
+static int poptSaveArgv(poptContext con, const char *** argvp,
+		/*@null@*/ const char * val)
+	/*@modifies con, *argvp @*/
+{
+    struct poptArgvTarget_s * t = NULL;
+    const char ** av;
+    int i;
+
+    if (argvp == NULL || val == NULL)
+	return POPT_ERROR_NULLARG;
+
+    for (i = 0; i < con->numArgvTargets; i++) {
+	if (con->argvTargets[i].argvp == argvp) {
+	    t = con->argvTargets + i;
+	    break;
+	}
+    }
+    if (t == NULL) {
+	t = realloc(con->argvTargets,
+		(con->numArgvTargets + 1) * sizeof(*con->argvTargets));
+	if (t == NULL)
+	    return POPT_ERROR_MALLOC;
+	con->argvTargets = t;
+	t += con->numArgvTargets++;
+	t->argvp = argvp;
+	t->argv = NULL;
+    }
+
+    /*
+     * (Re-)learn the vector unless it still ends with the arg appended
+     * last, so appends stay O(1) across poptGetNextOpt() calls and
+     * callbacks. The capacity of a vector popt didn't allocate is unknown,
+     * so it is taken as just enough.
+     */
+    if (!(t->argv != NULL && t->argv == *argvp && t->argc > 0
+     && t->argv[t->argc] == NULL && t->argv[t->argc - 1] == t->last))
+    {
+	t->argv = *argvp;
+	t->argc = 0;
+	if (t->argv != NULL)
+	while (t->argv[t->argc] != NULL)
+	    t->argc++;
+	t->alloced = (t->argv != NULL ? t->argc + 1 : 0);
+    }
+
+    if (t->argc + 2 > t->alloced) {
+	int alloced = (t->alloced < 8 ? 8 : 2 * t->alloced);
+/*@-unqualifiedtrans@*/	/* XXX no annotation for (*argvp) */
+	av = realloc(t->argv, alloced * sizeof(*av));
+/*@=unqualifiedtrans@*/
+	if (av == NULL)
+	    return POPT_ERROR_MALLOC;
+	t->argv = *argvp = av;
+	t->alloced = alloced;
+    }
+
+/*@-nullstate@*/
+    t->argv[t->argc++] = t->last = xstrdup(val);
+    t->argv[t->argc] = NULL;
+    return 0;
+/*@=nullstate@*/
+}
+
 /*@unchecked@*/
 static unsigned int seed = 0;
 
@@ -1176,6 +2380,181 @@ static int poptParseInteger(long long * llp,
     return 0;
 }
 
+/**
+ * Parse an integer expression in the C locale (POPT_CONTEXT_C_NUMERIC).
+ * The base is taken from the prefix as with strtoll(3), but an empty
+ * expression is an error and overflow is reported rather than clamped.
+ * @retval *llp		integer expression value
+ * @param val		integer expression string
+ * @return		0 on success, otherwise POPT_* error.
+ */
+static int poptParseIntegerC(long long * llp, /*@null@*/ const char * val)
+	/*@modifies *llp @*/
+{
+    const unsigned char * s = (const unsigned char *) val;
+    const unsigned char * digits;
+    unsigned long long u = 0;
+    unsigned long long cutoff;
+    unsigned int cutlim;
+    unsigned int base = 10;
+    unsigned int ovf = 0;
+    int neg;
+
+    if (val == NULL) {
+	*llp = 0;
+	return 0;
+    }
+
+    while (*s == ' ' || (*s >= '\t' && *s <= '\r'))
+	s++;
+    neg = (*s == '-');
+    s += (*s == '-' || *s == '+');
+    if (s[0] == '0') {
+	base = 8;
+	if ((s[1] | 0x20) == 'x' && isxdigit(s[2])) {
+	    base = 16;
+	    s += 2;
+	}
+    }
+
+    cutoff = ~0ULL / base;
+    cutlim = (unsigned int)(~0ULL % base);
+    for (digits = s; ; s++) {
+	unsigned int d = (unsigned int)*s - '0';
+	if (d > 9) {
+	    d = ((unsigned int)*s | 0x20) - 'a';
+	    d = (d < 6) ? d + 10 : base;
+	}
+	if (d >= base)
+	    break;
+	/* Note overflow, but keep consuming digits without branching. */
+	ovf |= (u > cutoff) | (u == cutoff && d > cutlim);
+	u = u * base + d;
+    }
+
+    if (s == digits || *s != '\0')
+	return POPT_ERROR_BADNUMBER;
+    if (ovf || u > (~0ULL >> 1) + (unsigned)neg)
+	return POPT_ERROR_OVERFLOW;
+    *llp = (neg && u) ? -(long long)(u - 1) - 1 : (neg ? 0 : (long long)u);
+    return 0;
+}
+
+/**
+ * Parse a floating point expression in the C locale (POPT_CONTEXT_C_NUMERIC).
+ * Decimal expressions of at most 19 significant digits with a small
+ * exponent are exact in double arithmetic (Clinger's fast path) and are
+ * converted without calling strtod(3). Everything else goes to strtod(3),
+ * with '.' mapped to the radix character of the current locale, so the
+ * result is the same as strtod(3) in the C locale either way.
+ * @retval *dp		floating point expression value
+ * @param val		floating point expression string
+ * @return		0 on success, otherwise POPT_* error.
+ */
+static int poptParseDoubleC(double * dp, const char * val)
+	/*@globals internalState @*/
+	/*@modifies *dp, internalState @*/
+{
+    const char * radix;
+    char * b = NULL;
+    char * end = NULL;
+    double d;
+    int saveerrno;
+    int rc = 0;
+
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+    static const double p10[] = {
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const unsigned char * s = (const unsigned char *) val;
+    unsigned long long m = 0;
+    unsigned int nd = 0;
+    unsigned int any = 0;
+    unsigned int c;
+    int e = 0;
+    int neg;
+
+    while (*s == ' ' || (*s >= '\t' && *s <= '\r'))
+	s++;
+    neg = (*s == '-');
+    s += (*s == '-' || *s == '+');
+
+    for (; (c = (unsigned int)*s - '0') <= 9; s++, any = 1) {
+	m = m * 10 + c;
+	nd += (m != 0);
+    }
+    if (*s == '.') {
+	for (s++; (c = (unsigned int)*s - '0') <= 9; s++, any = 1, e--) {
+	    m = m * 10 + c;
+	    nd += (m != 0);
+	}
+    }
+    if (any && (*s | 0x20) == 'e') {
+	int eneg, ex = 0;
+	s++;
+	eneg = (*s == '-');
+	s += (*s == '-' || *s == '+');
+	if ((unsigned int)*s - '0' > 9)
+	    any = 0;
+	for (; (c = (unsigned int)*s - '0') <= 9; s++)
+	    if (ex < 10000) ex = ex * 10 + (int)c;
+	e += (eneg ? -ex : ex);
+    }
+
+    if (any && *s == '\0' && nd <= 19 && m <= (1ULL << 53)) {
+	/* Shift excess exponent into the mantissa while that stays exact. */
+	while (e > 22 && m <= (1ULL << 53) / 10) {
+	    m *= 10;
+	    e--;
+	}
+	if (e >= -22 && e <= 22) {
+	    d = (double) m;
+	    d = (e < 0) ? d / p10[-e] : d * p10[e];
+	    *dp = (neg ? -d : d);
+	    return 0;
+	}
+    }
+#endif
+
+    radix = localeconv()->decimal_point;
+    if (radix != NULL && strcmp(radix, ".") && *radix != '\0') {
+	size_t nr = strlen(radix);
+	const char * t;
+	char * te;
+
+	/* The locale radix is not a radix in the C locale. */
+	if (strstr(val, radix) != NULL)
+	    return POPT_ERROR_BADNUMBER;
+	if ((b = malloc(strlen(val) * nr + 1)) == NULL)
+	    return POPT_ERROR_MALLOC;
+	for (t = val, te = b; *t != '\0'; t++) {
+	    if (*t == '.')
+		te = stpcpy(te, radix);
+	    else
+		*te++ = *t;
+	}
+	*te = '\0';
+	val = b;
+    }
+
+/*@-mods@*/
+    saveerrno = errno;
+    errno = 0;
+    d = strtod(val, &end);
+    if (errno == ERANGE)
+	rc = POPT_ERROR_OVERFLOW;
+    else if (end == val || *end != '\0')
+	rc = POPT_ERROR_BADNUMBER;
+    errno = saveerrno;
+/*@=mods@*/
+    b = _free(b);
+
+    if (rc == 0)
+	*dp = d;
+    return rc;
+}
+
 /**
  * Save the option argument through the (*opt->arg) pointer.
  * @param con		context
@@ -1196,7 +2575,7 @@ static int poptSaveArg(poptContext con, const struct poptOption * opt)
 	/*@switchbreak@*/ break;
     case POPT_ARG_ARGV:
 	/* XXX memory leak, application is responsible for free. */
-	rc = poptSaveString(arg.ptr, opt->argInfo, con->os->nextArg);
+	rc = poptSaveArgv(con, arg.ptr, con->os->nextArg);
 	/*@switchbreak@*/ break;
     case POPT_ARG_STRING:
 	/* XXX memory leak, application is responsible for free. */
@@ -1210,7 +2589,11 @@ static int poptSaveArg(poptContext con, const struct poptOption * opt)
     {	unsigned int argInfo = poptArgInfo(con, opt);
 	long long aNUM = 0;
 
-	if ((rc = poptParseInteger(&aNUM, argInfo, con->os->nextArg)) != 0)
+	if (con->flags & POPT_CONTEXT_C_NUMERIC)
+	    rc = poptParseIntegerC(&aNUM, con->os->nextArg);
+	else
+	    rc = poptParseInteger(&aNUM, argInfo, con->os->nextArg);
+	if (rc != 0)
 	    break;
 
 	switch (poptArgType(opt)) {
@@ -1247,7 +2630,10 @@ static int poptSaveArg(poptContext con, const struct poptOption * opt)
     {	char *end = NULL;
 	double aDouble = 0.0;
 
-	if (con->os->nextArg) {
+	if (con->os->nextArg && (con->flags & POPT_CONTEXT_C_NUMERIC)) {
+	    if ((rc = poptParseDoubleC(&aDouble, con->os->nextArg)) != 0)
+		break;
+	} else if (con->os->nextArg) {
 /*@-mods@*/
 	    int saveerrno = errno;
 	    errno = 0;
@@ -1296,6 +2682,47 @@ static int poptSaveArg(poptContext con, const struct poptOption * opt)
 }
 
 /* returns 'val' element, -1 on last item, POPT_ERROR_* on error */
+/**
+ * Append an option (and its argument) to the context's finalArgv.
+ * @param con		context
+ * @param opt		option
+ * @return		0 on success, POPT_ERROR_MALLOC on failure
+ */
+static int poptRecordOption(poptContext con, const struct poptOption * opt)
+	/*@modifies con @*/
+{
+    if (poptGrowFinalArgv(con, 2))
+	return POPT_ERROR_MALLOC;
+
+    if (con->finalArgv != NULL)
+    {   char *s = malloc((opt->longName ? strlen(opt->longName) : 0) + sizeof("--"));
+	if (s != NULL) {	/* XXX can't happen */
+	    con->finalArgv[con->finalArgvCount++] = s;
+	    *s++ = '-';
+	    if (opt->longName) {
+		if (!F_ISSET(opt, ONEDASH))
+		    *s++ = '-';
+		s = stpcpy(s, opt->longName);
+	    } else {
+		*s++ = opt->shortName;
+		*s = '\0';
+	    }
+	} else
+	    con->finalArgv[con->finalArgvCount++] = NULL;
+    }
+
+    if (opt->arg && poptArgType(opt) == POPT_ARG_NONE)
+	/*@-ifempty@*/ ; /*@=ifempty@*/
+    else if (poptArgType(opt) == POPT_ARG_VAL)
+	/*@-ifempty@*/ ; /*@=ifempty@*/
+    else if (poptArgType(opt) != POPT_ARG_NONE) {
+	if (con->finalArgv != NULL && con->os->nextArg != NULL)
+	    con->finalArgv[con->finalArgvCount++] =
+		    xstrdup(con->os->nextArg);
+    }
+    return 0;
+}
+
 int poptGetNextOpt(poptContext con)
 {
     const struct poptOption * opt = NULL;
@@ -1315,6 +2742,11 @@ int poptGetNextOpt(poptContext con)
 		&& con->os > con->optionStack) {
 	    cleanOSE(con->os--);
 	}
+	if (!con->os->nextCharArg && con->os->next == con->os->argc) {
+	    int rc = poptStreamPull(con);
+	    if (rc < 0)
+		return rc;
+	}
 	if (!con->os->nextCharArg && con->os->next == con->os->argc) {
 	    invokeCallbacksPOST(con, con->options);
 
@@ -1337,7 +2769,9 @@ int poptGetNextOpt(poptContext con)
 
 /*@-sizeoftype@*/
 	    if (con->os->argb && PBM_ISSET(con->os->next, con->os->argb)) {
-		con->os->next++;
+		/* Skip the whole run of args consumed by !#:+ expansion. */
+		con->os->next = PBM_NEXTCLR(con->os->next, con->os->argc,
+				con->os->argb);
 		continue;
 	    }
 /*@=sizeoftype@*/
@@ -1348,17 +2782,29 @@ int poptGetNextOpt(poptContext con)
 	    if (origOptString == NULL)	/* XXX can't happen */
 		return POPT_ERROR_BADOPT;
 
+	    /* Expand "@file" in place of the arg (but not after "--"). */
+	    if ((con->flags & POPT_CONTEXT_RESPONSE_FILES)
+	     && !con->restLeftover
+	     && origOptString[0] == '@' && origOptString[1] != '\0')
+	    {
+		int rc = handleResponseFile(con, origOptString + 1);
+		if (rc)
+		    return rc;
+		continue;
+	    }
+
 	    if (con->restLeftover || *origOptString != '-' ||
 		(*origOptString == '-' && origOptString[1] == '\0'))
 	    {
 		if (con->flags & POPT_CONTEXT_POSIXMEHARDER)
 		    con->restLeftover = 1;
 		if (con->flags & POPT_CONTEXT_ARG_OPTS) {
+		    con->os->nextArg = _free(con->os->nextArg);
 		    con->os->nextArg = xstrdup(origOptString);
 		    return 0;
 		}
-		if (con->leftovers != NULL)	/* XXX can't happen */
-		    con->leftovers[con->numLeftovers++] = origOptString;
+		if (poptAddLeftover(con, origOptString))
+		    return POPT_ERROR_MALLOC;
 		continue;
 	    }
 
@@ -1394,8 +2840,12 @@ int poptGetNextOpt(poptContext con)
 		    continue;
 		}
 
-		if (handleExec(con, optString, '\0'))
-		    continue;
+		{   int rc = handleExec(con, optString, '\0');
+		    if (rc < 0)
+			return rc;
+		    if (rc)
+			continue;
+		}
 
 		opt = findOption(con->options, optString, optStringLen, '\0', &cb, &cbData,
 				 argInfo);
@@ -1425,12 +2875,16 @@ int poptGetNextOpt(poptContext con)
 	    if (handleAlias(con, NULL, 0, *nextCharArg, nextCharArg + 1))
 		continue;
 
-	    if (handleExec(con, NULL, *nextCharArg)) {
-		/* Restore rest of short options for further processing */
-		nextCharArg++;
-		if (*nextCharArg != '\0')
-		    con->os->nextCharArg = nextCharArg;
-		continue;
+	    {   int rc = handleExec(con, NULL, *nextCharArg);
+		if (rc < 0)
+		    return rc;
+		if (rc) {
+		    /* Restore rest of short options for further processing */
+		    nextCharArg++;
+		    if (*nextCharArg != '\0')
+			con->os->nextCharArg = nextCharArg;
+		    continue;
+		}
 	    }
 
 	    opt = findOption(con->options, NULL, 0, *nextCharArg, &cb,
@@ -1472,6 +2926,9 @@ int poptGetNextOpt(poptContext con)
 		{
 		    cleanOSE(con->os--);
 		}
+		if (con->os->next == con->os->argc
+		 && (rc = poptStreamPull(con)) < 0)
+		    return rc;
 		if (con->os->next == con->os->argc) {
 		    if (!F_ISSET(opt, OPTIONAL))
 			return POPT_ERROR_NOARG;
@@ -1513,38 +2970,9 @@ int poptGetNextOpt(poptContext con)
 	else if (opt->val && (poptArgType(opt) != POPT_ARG_VAL))
 	    done = 1;
 
-	if ((con->finalArgvCount + 2) >= (con->finalArgvAlloced)) {
-	    con->finalArgvAlloced += 10;
-	    con->finalArgv = realloc(con->finalArgv,
-			    sizeof(*con->finalArgv) * con->finalArgvAlloced);
-	}
-
-	if (con->finalArgv != NULL)
-	{   char *s = malloc((opt->longName ? strlen(opt->longName) : 0) + sizeof("--"));
-	    if (s != NULL) {	/* XXX can't happen */
-		con->finalArgv[con->finalArgvCount++] = s;
-		*s++ = '-';
-		if (opt->longName) {
-		    if (!F_ISSET(opt, ONEDASH))
-			*s++ = '-';
-		    s = stpcpy(s, opt->longName);
-		} else {
-		    *s++ = opt->shortName;
-		    *s = '\0';
-		}
-	    } else
-		con->finalArgv[con->finalArgvCount++] = NULL;
-	}
-
-	if (opt->arg && poptArgType(opt) == POPT_ARG_NONE)
-	    /*@-ifempty@*/ ; /*@=ifempty@*/
-	else if (poptArgType(opt) == POPT_ARG_VAL)
-	    /*@-ifempty@*/ ; /*@=ifempty@*/
-	else if (poptArgType(opt) != POPT_ARG_NONE) {
-	    if (con->finalArgv != NULL && con->os->nextArg != NULL)
-	        con->finalArgv[con->finalArgvCount++] =
-			xstrdup(con->os->nextArg);
-	}
+	/* Record the option for execs and POPT_ARG_MAINCALL. */
+	if (con->stream == NULL && poptRecordOption(con, opt))
+	    return POPT_ERROR_MALLOC;
     }
 
     return (opt ? opt->val : -1);	/* XXX can't happen */
@@ -1628,6 +3056,9 @@ poptContext poptFreeContext(poptContext con)
     con->otherHelp = _free(con->otherHelp);
     con->execPath = _free(con->execPath);
     con->arg_strip = PBM_FREE(con->arg_strip);
+    con->stream = poptStreamFree(con->stream);
+    con->helpBuf.out.b = _free(con->helpBuf.out.b);
+    con->helpBuf.tmp.b = _free(con->helpBuf.tmp.b);
     
     con = _free(con);
     return con;
@@ -1750,10 +3181,14 @@ int poptStuffArgs(poptContext con, const char ** argv)
     con->os->nextArg = NULL;
     con->os->nextCharArg = NULL;
     con->os->currAlias = NULL;
-    rc = poptDupArgv(argc, argv, &con->os->argc, &con->os->argv);
+    rc = poptDupArgv(argc, argv, &con->os->argc, &con->os->argvbuf);
+    con->os->argv = con->os->argvbuf;
     con->os->argb = NULL;
     con->os->stuffed = 1;
 
+    if (rc == 0)
+	(void) poptGrowFinalArgv(con, 2 * con->os->argc);
+
     return rc;
 }
 
@@ -1764,24 +3199,35 @@ const char * poptGetInvocationName(poptContext con)
 
 int poptStrippedArgv(poptContext con, int argc, char ** argv)
 {
-    int numargs = argc;
-    int j = 1;
-    int i;
-    
+    unsigned int n = (argc > 0 ? (unsigned int) argc : 0);
+    unsigned int nb;
+    unsigned int i = 1;		/* skip argv[0] */
+    unsigned int j = 1;
+
+    if (con->arg_strip == NULL || n <= 1)
+	return argc;
+
+    /* arg_strip holds a bit for each of the original args. */
+    nb = (unsigned int) con->optionStack[0].argc + 1;
+    if (nb > n)
+	nb = n;
+
 /*@-sizeoftype@*/
-    if (con->arg_strip)
-    for (i = 1; i < argc; i++) {
-	if (PBM_ISSET(i, con->arg_strip))
-	    numargs--;
-    }
-    
-    for (i = 1; i < argc; i++) {
-	if (con->arg_strip && PBM_ISSET(i, con->arg_strip))
-	    continue;
-	argv[j] = (j < numargs) ? argv[i] : NULL;
-	j++;
+    /* Compact runs of kept args in one pass, skipping whole words. */
+    while (i < n) {
+	unsigned int k = PBM_NEXTSET(i, nb, con->arg_strip);
+	if (k >= nb)
+	    k = n;
+	if (j != i)
+	    memmove(argv + j, argv + i, (k - i) * sizeof(*argv));
+	j += k - i;
+	if (k >= n)
+	    break;
+	i = PBM_NEXTCLR(k, nb, con->arg_strip);
     }
 /*@=sizeoftype@*/
-    
-    return numargs;
+
+    if (j < n)
+	argv[j] = NULL;
+    return (int) j;
 }
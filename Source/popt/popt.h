@@ -118,6 +118,8 @@
 #define POPT_CONTEXT_KEEP_FIRST	(1U << 1)  /*!< pay attention to argv[0] */
 #define POPT_CONTEXT_POSIXMEHARDER (1U << 2) /*!< options can't follow args */
 #define POPT_CONTEXT_ARG_OPTS	(1U << 4) /*!< return args as options with value 0 */
+#define POPT_CONTEXT_C_NUMERIC	(1U << 5) /*!< locale independent, strict numeric args */
+#define POPT_CONTEXT_RESPONSE_FILES (1U << 6) /*!< expand @file args */
 /*@}*/
 
 /** \ingroup popt
@@ -148,6 +150,20 @@ struct poptAlias {
     const char ** argv;		/*!< must be free()able */
 };
 
+/** \ingroup popt
+ * Help and usage text rendered ahead of time (e.g. at build time with
+ * poptHelpString() and poptUsageString()) for one output width.
+ */
+struct poptPrerendered {
+/*@observer@*/
+    const char * argv0;		/*!< basename of argv[0], "" with KEEP_FIRST */
+    int columns;		/*!< output width the text was rendered for */
+/*@observer@*/
+    const char * help;		/*!< poptPrintHelp() text */
+/*@observer@*/
+    const char * usage;		/*!< poptPrintUsage() text */
+};
+
 /** \ingroup popt
  * A popt alias or exec argument for poptAddItem().
  */
@@ -239,6 +255,41 @@ typedef void (*poptCallbackType) (poptContext con,
 	/*@globals internalState @*/
 	/*@modifies internalState @*/;
 
+/** \ingroup popt
+ * Argument iterator for poptGetStreamContext().
+ * It is called while options are being saved, so it must not change
+ * option targets (e.g. free a POPT_ARG_ARGV vector).
+ * @param data		iterator private data
+ * @return		next argument (valid until the next call), NULL at end
+ */
+typedef /*@null@*/ const char * (*poptArgIterator) (/*@null@*/ void * data)
+	/*@*/;
+
+/** \ingroup popt
+ * Initialize popt context that pulls arguments from an iterator.
+ * The first argument pulled is argv[0]. Only the two most recent arguments
+ * are kept, so memory use does not depend on the number of arguments.
+ * Implies POPT_CONTEXT_ARG_OPTS (non-option arguments are returned by
+ * poptGetNextOpt() as 0, see poptGetOptArg()) and POPT_CONTEXT_NO_EXEC;
+ * "!#:+" is not expanded, options are not recorded for POPT_ARG_MAINCALL,
+ * and poptStrippedArgv() does not apply.  If an argument can't be kept,
+ * poptGetNextOpt() returns POPT_ERROR_MALLOC, rather than ending early.
+ * @param name		context name (usually argv[0] program name)
+ * @param next		argument iterator
+ * @param data		argument iterator private data
+ * @param options	address of popt option table
+ * @param flags		or'd POPT_CONTEXT_* bits
+ * @return		initialized popt context (NULL on error).
+ */
+/*@only@*/ /*@null@*/
+poptContext poptGetStreamContext(
+		/*@dependent@*/ /*@keep@*/ const char * name,
+		poptArgIterator next, /*@null@*/ void * data,
+		/*@dependent@*/ /*@keep@*/ const struct poptOption * options,
+		unsigned int flags)
+	/*@globals internalState @*/
+	/*@modifies internalState @*/;
+
 /** \ingroup popt
  * Destroy context.
  * @param con		context
@@ -569,6 +620,46 @@ void poptPrintUsage(poptContext con, FILE * fp, /*@unused@*/ int flags)
 	/*@globals fileSystem @*/
 	/*@modifies fp, fileSystem @*/;
 
+/** \ingroup popt
+ * Return detailed description of options, rendered for a given width.
+ * @param con		context
+ * @param columns	output width
+ * @return		description (malloc'd), NULL on failure
+ */
+/*@-fcnuse@*/
+/*@only@*/ /*@null@*/
+char * poptHelpString(poptContext con, int columns)
+	/*@modifies con @*/;
+/*@=fcnuse@*/
+
+/** \ingroup popt
+ * Return terse description of options, rendered for a given width.
+ * @param con		context
+ * @param columns	output width
+ * @return		description (malloc'd), NULL on failure
+ */
+/*@-fcnuse@*/
+/*@only@*/ /*@null@*/
+char * poptUsageString(poptContext con, int columns)
+	/*@modifies con @*/;
+/*@=fcnuse@*/
+
+/** \ingroup popt
+ * Use prerendered help and usage text where it matches.
+ * poptPrintHelp() and poptPrintUsage() then write the entry for the
+ * output width and argv[0] as is. They render dynamically if no entry
+ * matches, or if aliases, execs or other option help were added (which
+ * change the text), or if messages are translated.
+ * The text must have been rendered from the same option table.
+ * @param con		context
+ * @param table		prerendered text, terminated by an entry with NULL argv0
+ */
+/*@-fcnuse@*/
+void poptSetPrerendered(poptContext con,
+		/*@keep@*/ /*@null@*/ const struct poptPrerendered * table)
+	/*@modifies con @*/;
+/*@=fcnuse@*/
+
 /** \ingroup popt
  * Provide text to replace default "[OPTION...]" in help/usage output.
  * @param con		context
@@ -679,17 +770,17 @@ int poptSaveInt(/*@null@*/ int * arg, unsigned int argInfo, long aLong)
 	/*@requires maxSet(arg) >= 0 /\ maxRead(arg) == 0 @*/;
 /*@=incondefs@*/
 
-/* The bit set typedef. */
+/* The bit set typedef (opaque, see poptBitsNew()). */
 /*@-exporttype@*/
-typedef struct poptBits_s {
-    unsigned int bits[1];
-} * poptBits;
+typedef struct poptBits_s * poptBits;
 /*@=exporttype@*/
 
 #define _POPT_BITS_N    1024U    /* estimated population */
 #define _POPT_BITS_M    ((3U * _POPT_BITS_N) / 2U)
 #define _POPT_BITS_K    16U      /* no. of linear hash combinations */
 
+/* Geometry of bit sets popt allocates lazily, e.g. for POPT_ARG_BITSET.
+ * Read when such a set is allocated, the set keeps its own copy. */
 /*@-exportlocal -exportvar -globuse @*/
 /*@unchecked@*/
 extern unsigned int _poptBitsN;
@@ -697,8 +788,41 @@ extern unsigned int _poptBitsN;
 extern  unsigned int _poptBitsM;
 /*@unchecked@*/
 extern  unsigned int _poptBitsK;
+/*@unchecked@*/
+extern  unsigned int _poptBitsFlags;
 /*@=exportlocal =exportvar =globuse @*/
 
+/**
+ * Bit set layout (poptBitsNew() flags, _poptBitsFlags).
+ */
+#define	POPT_BITS_BLOCKED	(1U << 0)  /*!< probes of a member share one 64 byte block */
+#define	POPT_BITS_COUNTING	(1U << 1)  /*!< 4 bit counters, so poptBitsDel() is exact */
+#define	POPT_BITS_XXH64		(1U << 2)  /*!< hash with XXH64 (default: lookup3) */
+#define	POPT_BITS_RDONLY	(1U << 3)  /*!< (poptBitsLoad() only) mapped read-only */
+
+/**
+ * Allocate an empty bit set, sized for a population and false positive rate.
+ * Blocked sets are rounded up to a power of 2 no. of blocks, and trade a
+ * somewhat higher false positive rate for one cache line per member.
+ * @retval *bitsp	bit set
+ * @param n		expected no. of members
+ * @param fpr		false positive rate at n members, 0 < fpr < 1
+ * @param flags		bit set layout (POPT_BITS_*)
+ * @return		0 on success, POPT_ERROR_BADNUMBER/POPT_ERROR_MALLOC
+ */
+int poptBitsNew(/*@null@*/ /*@out@*/ poptBits * bitsp, unsigned int n,
+		double fpr, unsigned int flags)
+	/*@modifies *bitsp @*/;
+
+/**
+ * Destroy a bit set.
+ * @param bits		bit set
+ * @return		NULL always
+ */
+/*@null@*/
+poptBits poptBitsFree(/*@only@*/ /*@null@*/ poptBits bits)
+	/*@modifies bits @*/;
+
 /*@-exportlocal@*/
 int poptBitsAdd(/*@null@*/poptBits bits, /*@null@*/const char * s)
 	/*@modifies bits @*/;
@@ -717,6 +841,56 @@ int poptBitsUnion(/*@null@*/ poptBits * ap, /*@null@*/ const poptBits b)
 	/*@modifies *ap @*/;
 int poptBitsArgs(/*@null@*/ poptContext con, /*@null@*/ poptBits * ap)
 	/*@modifies con, *ap @*/;
+
+/**
+ * Estimate the no. of members of a bit set from its population count.
+ * @param bits		bit set
+ * @return		estimated no. of members, POPT_ERROR_NULLARG if NULL
+ */
+int poptBitsCount(/*@null@*/ const poptBits bits)
+	/*@*/;
+
+/**
+ * Estimate the Jaccard similarity |a AND b| / |a OR b| of two bit sets.
+ * @param a		1st bit set
+ * @param b		2nd bit set, with the same geometry
+ * @retval *jp		0.0 (disjoint) to 1.0 (same members)
+ * @return		0 on success, POPT_ERROR_NULLARG/POPT_ERROR_BADOPERATION
+ */
+int poptBitsJaccard(/*@null@*/ const poptBits a, /*@null@*/ const poptBits b,
+		/*@null@*/ /*@out@*/ double * jp)
+	/*@modifies *jp @*/;
+
+/**
+ * Save a bit set to a file: a 64 byte header (magic, version, byte order,
+ * geometry and hash), then the words of the set in native byte order.
+ * The file is written as fn.tmp, then renamed over fn, so that processes
+ * which have fn mapped keep their (old) pages.
+ * @param bits		bit set
+ * @param fn		file name
+ * @return		0 on success, POPT_ERROR_NULLARG/POPT_ERROR_ERRNO
+ */
+int poptBitsSave(/*@null@*/ const poptBits bits, /*@null@*/ const char * fn)
+	/*@globals errno, fileSystem, internalState @*/
+	/*@modifies errno, fileSystem, internalState @*/;
+
+/**
+ * Load a bit set saved by poptBitsSave().
+ * Where mmap() is available, the words are not read but mapped read-only
+ * and shared, and the set is POPT_BITS_RDONLY: poptBitsChk(), Count() and
+ * Jaccard() work, and it can be merged into other sets, but changing it
+ * fails with POPT_ERROR_BADOPERATION.  poptBitsFree() unmaps it.
+ * Otherwise the words are read into an ordinary set.
+ * @retval *bitsp	bit set
+ * @param fn		file name
+ * @return		0 on success, POPT_ERROR_NULLARG/POPT_ERROR_ERRNO/
+ *			POPT_ERROR_MALLOC, or POPT_ERROR_BADCONFIG if fn is
+ *			not a bit set saved on a machine of this byte order
+ */
+int poptBitsLoad(/*@null@*/ /*@out@*/ poptBits * bitsp,
+		/*@null@*/ const char * fn)
+	/*@globals errno, fileSystem, internalState @*/
+	/*@modifies *bitsp, errno, fileSystem, internalState @*/;
 /*@=fcnuse@*/
 /*@=exportlocal@*/
 
@@ -732,7 +906,7 @@ int poptBitsArgs(/*@null@*/ poptContext con, /*@null@*/ poptBits * ap)
 int poptSaveBits(/*@null@*/ poptBits * bitsp, unsigned int argInfo,
 		/*@null@*/ const char * s)
 	/*@globals _poptBitsN, _poptBitsM, _poptBitsK, internalState @*/
-	/*@modifies *bitsp, _poptBitsN, _poptBitsM, _poptBitsK, internalState @*/;
+	/*@modifies *bitsp, internalState @*/;
 /*@=incondefs@*/
 
 /*@=type@*/
@@ -75,7 +75,7 @@ glob_pattern_p (const char * pattern, int quote)
 #endif	/* !defined(__GLIBC__) */
 
 /*@unchecked@*/
-static int poptGlobFlags = 0;
+static const int poptGlobFlags = 0;
 
 static int poptGlob_error(/*@unused@*/ UNUSED(const char * epath),
 		/*@unused@*/ UNUSED(int eerrno))
@@ -247,9 +247,10 @@ static int configAppMatch(poptContext con, const char * s)
 #if defined(HAVE_GLOB_H) && defined(HAVE_FNMATCH_H)
     if (glob_pattern_p(s, 1)) {
 /*@-bitwisesigned@*/
-	static int flags = FNM_PATHNAME | FNM_PERIOD;
 #ifdef FNM_EXTMATCH
-	flags |= FNM_EXTMATCH;
+	const int flags = FNM_PATHNAME | FNM_PERIOD | FNM_EXTMATCH;
+#else
+	const int flags = FNM_PATHNAME | FNM_PERIOD;
 #endif
 /*@=bitwisesigned@*/
 	rc = fnmatch(s, con->appName, flags);
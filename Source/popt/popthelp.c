@@ -9,17 +9,16 @@
    ftp://ftp.rpm.org/pub/rpm/dist. */
 
 #include "system.h"
+#include <stdarg.h>
+#if defined(ENABLE_NLS) && defined(HAVE_DCGETTEXT)
+#include <locale.h>
+#endif
 
 #define        POPT_USE_TIOCGWINSZ
 #ifdef POPT_USE_TIOCGWINSZ
 #include <sys/ioctl.h>
 #endif
 
-#define	POPT_WCHAR_HACK
-#ifdef 	POPT_WCHAR_HACK
-#include <wchar.h>			/* for mbsrtowcs */
-/*@access mbstate_t @*/
-#endif
 #include "poptint.h"
 
 /*@access poptContext@*/
@@ -104,6 +103,150 @@ typedef struct columns_s {
     size_t max;
 } * columns_t;
 
+typedef struct poptBuf_s * poptBuf;
+typedef struct poptHelpBuf_s * poptHelpBuf;
+
+/**
+ * Make room for n more bytes (and a NUL) in a buffer.
+ * @param ob		buffer
+ * @param n		no. of bytes about to be appended
+ * @return		0 on success, -1 if malloc failed (now or before)
+ */
+static int bufReserve(poptBuf ob, size_t n)
+	/*@modifies ob @*/
+{
+    size_t alloced = ob->alloced;
+    char * b;
+
+    if (ob->err)
+	return -1;
+    if (ob->nb + n < alloced)
+	return 0;
+    if (alloced < 256)
+	alloced = 256;
+    while (ob->nb + n >= alloced)
+	alloced *= 2;
+    if ((b = realloc(ob->b, alloced)) == NULL) {
+	ob->err = 1;
+	return -1;
+    }
+    ob->b = b;
+    ob->alloced = alloced;
+    return 0;
+}
+
+/**
+ * Append n bytes of a string to a buffer.
+ * @param ob		buffer
+ * @param s		string
+ * @param n		no. of bytes
+ */
+static void bufPutn(poptBuf ob, const char * s, size_t n)
+	/*@modifies ob @*/
+{
+    if (bufReserve(ob, n))
+	return;
+    memcpy(ob->b + ob->nb, s, n);
+    ob->nb += n;
+    ob->b[ob->nb] = '\0';
+}
+
+static void bufPuts(poptBuf ob, const char * s)
+	/*@modifies ob @*/
+{
+    bufPutn(ob, s, strlen(s));
+}
+
+static void bufPutc(poptBuf ob, char c)
+	/*@modifies ob @*/
+{
+    bufPutn(ob, &c, 1);
+}
+
+/**
+ * Append n blanks to a buffer.
+ * @param ob		buffer
+ * @param n		no. of blanks
+ */
+static void bufPad(poptBuf ob, size_t n)
+	/*@modifies ob @*/
+{
+    if (bufReserve(ob, n))
+	return;
+    memset(ob->b + ob->nb, ' ', n);
+    ob->nb += n;
+    ob->b[ob->nb] = '\0';
+}
+
+/**
+ * Append printf(3) formatted text to a buffer.
+ * @param ob		buffer
+ * @param fmt		format
+ */
+static void bufPrintf(poptBuf ob, const char * fmt, ...)
+	/*@modifies ob @*/
+{
+    va_list ap;
+    int rc;
+
+    if (bufReserve(ob, 64))
+	return;
+    va_start(ap, fmt);
+    rc = vsnprintf(ob->b + ob->nb, ob->alloced - ob->nb, fmt, ap);
+    va_end(ap);
+    if (rc < 0)
+	return;
+    if ((size_t)rc >= ob->alloced - ob->nb) {
+	if (bufReserve(ob, (size_t)rc))
+	    return;
+	va_start(ap, fmt);
+	rc = vsnprintf(ob->b + ob->nb, ob->alloced - ob->nb, fmt, ap);
+	va_end(ap);
+	if (rc < 0)
+	    return;
+    }
+    ob->nb += (size_t)rc;
+}
+
+/**
+ * Write the rendered text, and empty the buffers for the next render.
+ * @param hb		help buffers
+ * @param fp		output file handle
+ */
+static void bufFlush(poptHelpBuf hb, FILE * fp)
+	/*@globals fileSystem @*/
+	/*@modifies hb, fp, fileSystem @*/
+{
+    if (hb->out.b != NULL && hb->out.nb > 0)
+	(void) POPT_fwrite(hb->out.b, hb->out.nb, fp);
+    hb->out.nb = 0;
+    hb->out.err = 0;
+    hb->tmp.nb = 0;
+    hb->tmp.err = 0;
+}
+
+/**
+ * Return a copy of the rendered text, and empty the buffers.
+ * @param hb		help buffers
+ * @return		rendered text (malloc'd), NULL on failure
+ */
+static /*@only@*/ /*@null@*/ char * bufTake(poptHelpBuf hb)
+	/*@modifies hb @*/
+{
+    char * t = NULL;
+
+    if (!hb->out.err && (t = malloc(hb->out.nb + 1)) != NULL) {
+	if (hb->out.nb > 0)
+	    memcpy(t, hb->out.b, hb->out.nb);
+	t[hb->out.nb] = '\0';
+    }
+    hb->out.nb = 0;
+    hb->out.err = 0;
+    hb->tmp.nb = 0;
+    hb->tmp.err = 0;
+    return t;
+}
+
 /** 
  * Return no. of columns in output window.
  * @param fp           FILE
@@ -128,27 +271,249 @@ static size_t maxColumnWidth(FILE *fp)
 }   
 
 /**
- * Determine number of display characters in a string.
+ * Non-ASCII code points that aren't 1 column wide: combining marks and
+ * other zero width characters, and the East Asian Wide/Fullwidth blocks.
+ * Sorted and non-overlapping, for a binary search.
+ */
+/*@unchecked@*/ /*@observer@*/
+static const struct poptWidthRange_s {
+    uint32_t first;
+    uint32_t last;
+    unsigned int width;
+} poptWidthRanges[] = {
+    { 0x00ad, 0x00ad, 0 },	/* soft hyphen */
+    { 0x0300, 0x036f, 0 },	/* combining diacritical marks */
+    { 0x0483, 0x0489, 0 },
+    { 0x0591, 0x05bd, 0 },
+    { 0x05bf, 0x05bf, 0 },
+    { 0x05c1, 0x05c2, 0 },
+    { 0x05c4, 0x05c5, 0 },
+    { 0x05c7, 0x05c7, 0 },
+    { 0x0610, 0x061a, 0 },
+    { 0x064b, 0x065f, 0 },
+    { 0x0670, 0x0670, 0 },
+    { 0x06d6, 0x06dc, 0 },
+    { 0x06df, 0x06e4, 0 },
+    { 0x06e7, 0x06e8, 0 },
+    { 0x06ea, 0x06ed, 0 },
+    { 0x0e31, 0x0e31, 0 },
+    { 0x0e34, 0x0e3a, 0 },
+    { 0x0e47, 0x0e4e, 0 },
+    { 0x1100, 0x115f, 2 },	/* Hangul Jamo initial consonants */
+    { 0x1160, 0x11ff, 0 },	/* Hangul Jamo medial vowels, finals */
+    { 0x1ab0, 0x1aff, 0 },
+    { 0x1dc0, 0x1dff, 0 },
+    { 0x200b, 0x200f, 0 },	/* zero width space, joiners, marks */
+    { 0x202a, 0x202e, 0 },
+    { 0x2060, 0x2064, 0 },
+    { 0x20d0, 0x20ff, 0 },
+    { 0x231a, 0x231b, 2 },
+    { 0x2329, 0x232a, 2 },
+    { 0x23e9, 0x23ec, 2 },
+    { 0x23f0, 0x23f0, 2 },
+    { 0x23f3, 0x23f3, 2 },
+    { 0x25fd, 0x25fe, 2 },
+    { 0x2614, 0x2615, 2 },
+    { 0x2648, 0x2653, 2 },
+    { 0x26aa, 0x26ab, 2 },
+    { 0x26bd, 0x26be, 2 },
+    { 0x26c4, 0x26c5, 2 },
+    { 0x26d4, 0x26d4, 2 },
+    { 0x26ea, 0x26ea, 2 },
+    { 0x26f2, 0x26f5, 2 },
+    { 0x26fa, 0x26fa, 2 },
+    { 0x26fd, 0x26fd, 2 },
+    { 0x2705, 0x2705, 2 },
+    { 0x270a, 0x270b, 2 },
+    { 0x2728, 0x2728, 2 },
+    { 0x274c, 0x274c, 2 },
+    { 0x2753, 0x2755, 2 },
+    { 0x2757, 0x2757, 2 },
+    { 0x2795, 0x2797, 2 },
+    { 0x27b0, 0x27b0, 2 },
+    { 0x27bf, 0x27bf, 2 },
+    { 0x2b1b, 0x2b1c, 2 },
+    { 0x2b50, 0x2b50, 2 },
+    { 0x2b55, 0x2b55, 2 },
+    { 0x2e80, 0x302f, 2 },	/* CJK radicals ... CJK symbols */
+    { 0x3030, 0x303e, 2 },
+    { 0x3041, 0x3098, 2 },	/* Hiragana */
+    { 0x3099, 0x309a, 0 },	/* combining kana voicing marks */
+    { 0x309b, 0xa4cf, 2 },	/* Katakana ... CJK ideographs ... Yi */
+    { 0xa960, 0xa97f, 2 },	/* Hangul Jamo extended-A */
+    { 0xac00, 0xd7a3, 2 },	/* Hangul syllables */
+    { 0xf900, 0xfaff, 2 },	/* CJK compatibility ideographs */
+    { 0xfe00, 0xfe0f, 0 },	/* variation selectors */
+    { 0xfe10, 0xfe19, 2 },	/* vertical forms */
+    { 0xfe20, 0xfe2f, 0 },	/* combining half marks */
+    { 0xfe30, 0xfe6f, 2 },	/* CJK compatibility forms */
+    { 0xfeff, 0xfeff, 0 },	/* byte order mark */
+    { 0xff00, 0xff60, 2 },	/* fullwidth forms */
+    { 0xffe0, 0xffe6, 2 },
+    { 0x16fe0, 0x16fe4, 2 },
+    { 0x17000, 0x18cff, 2 },	/* Tangut */
+    { 0x1b000, 0x1b2ff, 2 },	/* Kana supplement ... Nushu */
+    { 0x1f004, 0x1f004, 2 },
+    { 0x1f0cf, 0x1f0cf, 2 },
+    { 0x1f18e, 0x1f18e, 2 },
+    { 0x1f191, 0x1f19a, 2 },
+    { 0x1f200, 0x1f2ff, 2 },	/* enclosed ideographic supplement */
+    { 0x1f300, 0x1f64f, 2 },	/* pictographs, emoticons */
+    { 0x1f680, 0x1f6ff, 2 },	/* transport and map symbols */
+    { 0x1f7e0, 0x1f7eb, 2 },
+    { 0x1f900, 0x1f9ff, 2 },	/* supplemental pictographs */
+    { 0x1fa70, 0x1faff, 2 },
+    { 0x20000, 0x2fffd, 2 },	/* CJK extension B ... */
+    { 0x30000, 0x3fffd, 2 },	/* CJK extension G ... */
+    { 0xe0001, 0xe007f, 0 },	/* tags */
+    { 0xe0100, 0xe01ef, 0 },	/* variation selectors supplement */
+};
+
+/**
+ * Return no. of display columns of a (non-ASCII) code point.
+ * @param c		code point
+ * @return		no. of columns (0, 1 or 2)
+ */
+static unsigned int codePointWidth(uint32_t c)
+	/*@*/
+{
+    size_t lo = 0;
+    size_t hi = sizeof(poptWidthRanges) / sizeof(poptWidthRanges[0]);
+
+    while (lo < hi) {
+	size_t mid = (lo + hi) / 2;
+	if (c < poptWidthRanges[mid].first)
+	    hi = mid;
+	else if (c > poptWidthRanges[mid].last)
+	    lo = mid + 1;
+	else
+	    return poptWidthRanges[mid].width;
+    }
+    return 1;
+}
+
+/**
+ * Decode the (non-ASCII) UTF-8 character at s, reading at most n bytes.
+ * The decode stops at the first byte that isn't a continuation byte, so
+ * it never reads past a NUL terminator. A malformed sequence decodes as
+ * a single (1 column) byte.
  * @param s		string
- * @return		no. of display characters.
+ * @param n		no. of bytes available
+ * @retval *cp		code point
+ * @return		no. of bytes used
  */
-static inline size_t stringDisplayWidth(const char *s)
+static size_t utf8Decode(const unsigned char * s, size_t n, uint32_t * cp)
+	/*@modifies *cp @*/
+{
+    size_t nb;
+    size_t i;
+    uint32_t c = s[0];
+
+    if (c >= 0xf0 && c < 0xf5) {
+	nb = 4;
+	c &= 0x07;
+    } else if (c >= 0xe0) {
+	nb = 3;
+	c &= 0x0f;
+    } else if (c >= 0xc2 && c < 0xe0) {
+	nb = 2;
+	c &= 0x1f;
+    } else
+	nb = 0;
+
+    if (nb == 0 || nb > n)
+	goto bad;
+    for (i = 1; i < nb; i++) {
+	if ((s[i] & 0xc0) != 0x80)
+	    goto bad;
+	c = (c << 6) | (s[i] & 0x3f);
+    }
+    *cp = c;
+    return nb;
+
+bad:
+    *cp = 0xfffd;
+    return 1;
+}
+
+#define	_ASCII_HIGHS	((uint64_t)0x8080808080808080ULL)
+
+/**
+ * Determine number of display columns in (the first n bytes of) a string.
+ * Pure ASCII runs are checked for high bits a 64 bit word at a time.
+ * @param s		string (UTF-8)
+ * @param n		no. of bytes
+ * @return		no. of display columns
+ */
+static size_t stringDisplayWidthN(const char * s, size_t n)
 	/*@*/
 {
-    size_t n = strlen(s);
-#ifdef	POPT_WCHAR_HACK
-    mbstate_t t;
+    const unsigned char * p = (const unsigned char *) s;
+    const unsigned char * pe = p + n;
+    size_t w = 0;
+
+    while (p < pe) {
+	while ((size_t)(pe - p) >= sizeof(uint64_t)) {
+	    uint64_t x;
+	    memcpy(&x, p, sizeof(x));
+	    if (x & _ASCII_HIGHS)
+		break;
+	    p += sizeof(x);
+	    w += sizeof(x);
+	}
+	if (p >= pe)
+	    break;
+	if (*p < 0x80) {
+	    p++;
+	    w++;
+	} else {
+	    uint32_t c;
+	    p += utf8Decode(p, (size_t)(pe - p), &c);
+	    w += codePointWidth(c);
+	}
+    }
+    return w;
+}
 
-    memset ((void *)&t, 0, sizeof (t));	/* In initial state.  */
-    /* Determine number of display characters.  */
-    n = mbsrtowcs (NULL, &s, n, &t);
-#else
-    n = 0;
-    for (; *s; s = POPT_next_char(s))
-	n++;
-#endif
+/**
+ * Determine number of display columns in a string.
+ * @param s		string (UTF-8)
+ * @return		no. of display columns
+ */
+static inline size_t stringDisplayWidth(const char *s)
+	/*@*/
+{
+    return stringDisplayWidthN(s, strlen(s));
+}
 
-    return n;
+/**
+ * Find the end of the longest prefix of a string that fits in cols
+ * display columns (zero width characters stay with the preceding one).
+ * @param s		string (UTF-8)
+ * @param cols		no. of display columns
+ * @return		end of prefix
+ */
+static /*@observer@*/ const char *
+stringDisplayPrefix(/*@returned@*/ const char * s, size_t cols)
+	/*@*/
+{
+    const unsigned char * p = (const unsigned char *) s;
+    size_t w = 0;
+
+    while (*p != '\0') {
+	size_t nb = 1;
+	size_t cw = 1;
+	if (*p >= 0x80) {
+	    uint32_t c;
+	    nb = utf8Decode(p, (size_t)4, &c);
+	    cw = codePointWidth(c);
+	}
+	if (w + cw > cols)
+	    break;
+	w += cw;
+	p += nb;
+    }
+    return (const char *) p;
 }
 
 /**
@@ -218,98 +583,110 @@ getArgDescrip(const struct poptOption * opt,
 
 /**
  * Display default value for an option.
+ * @param ob		output buffer
  * @param lineLength	display positions remaining
  * @param opt		option(s)
  * @param translation_domain	translation domain
- * @return
+ * @return		0 if appended, -1 if the option has no default value
  */
-static /*@only@*/ /*@null@*/ char *
-singleOptionDefaultValue(size_t lineLength,
+static int
+singleOptionDefaultValue(poptBuf ob, size_t lineLength,
 		const struct poptOption * opt,
 		/*@-paramuse@*/ /* FIX: i18n macros disabled with lclint */
 		/*@null@*/ const char * translation_domain)
 		/*@=paramuse@*/
-	/*@*/
+	/*@modifies ob @*/
 {
     const char * defstr = D_(translation_domain, "default");
-    char * le = malloc(4*lineLength + 1);
-    char * l = le;
-
-    if (le == NULL) return NULL;	/* XXX can't happen */
-    *le = '\0';
-    *le++ = '(';
-    le = stpcpy(le, defstr);
-    *le++ = ':';
-    *le++ = ' ';
+    size_t start = ob->nb;
+
+    if (opt->arg)
+    switch (poptArgType(opt)) {
+    case POPT_ARG_VAL:
+    case POPT_ARG_INT:
+    case POPT_ARG_SHORT:
+    case POPT_ARG_LONG:
+    case POPT_ARG_LONGLONG:
+    case POPT_ARG_FLOAT:
+    case POPT_ARG_DOUBLE:
+    case POPT_ARG_MAINCALL:
+    case POPT_ARG_ARGV:
+    case POPT_ARG_STRING:
+	break;
+    case POPT_ARG_NONE:
+    default:
+	return -1;
+	/*@notreached@*/ break;
+    }
+
+    bufPrintf(ob, "(%s: ", defstr);
   if (opt->arg) {	/* XXX programmer error */
     poptArg arg = { .ptr = opt->arg };
     switch (poptArgType(opt)) {
     case POPT_ARG_VAL:
     case POPT_ARG_INT:
-	le += sprintf(le, "%d", arg.intp[0]);
+	bufPrintf(ob, "%d", arg.intp[0]);
 	break;
     case POPT_ARG_SHORT:
-	le += sprintf(le, "%hd", arg.shortp[0]);
+	bufPrintf(ob, "%hd", arg.shortp[0]);
 	break;
     case POPT_ARG_LONG:
-	le += sprintf(le, "%ld", arg.longp[0]);
+	bufPrintf(ob, "%ld", arg.longp[0]);
 	break;
     case POPT_ARG_LONGLONG:
-	le += sprintf(le, "%lld", arg.longlongp[0]);
+	bufPrintf(ob, "%lld", arg.longlongp[0]);
 	break;
     case POPT_ARG_FLOAT:
     {	double aDouble = (double) arg.floatp[0];
-	le += sprintf(le, "%g", aDouble);
+	bufPrintf(ob, "%g", aDouble);
     }	break;
     case POPT_ARG_DOUBLE:
-	le += sprintf(le, "%g", arg.doublep[0]);
+	bufPrintf(ob, "%g", arg.doublep[0]);
 	break;
     case POPT_ARG_MAINCALL:
-	le += sprintf(le, "%p", opt->arg);
+	bufPrintf(ob, "%p", opt->arg);
 	break;
     case POPT_ARG_ARGV:
-	le += sprintf(le, "%p", opt->arg);
+	bufPrintf(ob, "%p", opt->arg);
 	break;
     case POPT_ARG_STRING:
     {	const char * s = arg.argv[0];
 	if (s == NULL)
-	    le = stpcpy(le, "null");
+	    bufPuts(ob, "null");
 	else {
-	    size_t limit = 4*lineLength - (le - l) - sizeof("\"\")");
-	    size_t slen;
-	    *le++ = '"';
-	    strncpy(le, s, limit); le[limit] = '\0'; le += (slen = strlen(le));
-	    if (slen == limit && s[limit])
-		le[-1] = le[-2] = le[-3] = '.';
-	    *le++ = '"';
+	    size_t limit = 4*lineLength - (ob->nb - start) - sizeof("\"\")");
+	    size_t slen = strlen(s);
+	    bufPutc(ob, '"');
+	    if (slen > limit) {
+		bufPutn(ob, s, limit - 3);
+		bufPuts(ob, "...");
+	    } else
+		bufPutn(ob, s, slen);
+	    bufPutc(ob, '"');
 	}
     }	break;
-    case POPT_ARG_NONE:
     default:
-	l = _free(l);
-	return NULL;
-	/*@notreached@*/ break;
+	break;
     }
   }
-    *le++ = ')';
-    *le = '\0';
+    bufPutc(ob, ')');
 
-    return l;
+    return 0;
 }
 
 /**
  * Display help text for an option.
- * @param fp		output file handle
+ * @param hb		help buffers
  * @param columns	output display width control
  * @param opt		option(s)
  * @param translation_domain	translation domain
  */
-static void singleOptionHelp(FILE * fp, columns_t columns,
+static void singleOptionHelp(poptHelpBuf hb, columns_t columns,
 		const struct poptOption * opt,
 		/*@null@*/ const char * translation_domain)
-	/*@globals fileSystem @*/
-	/*@modifies fp, fileSystem @*/
+	/*@modifies hb @*/
 {
+    poptBuf ob = &hb->out;
     size_t maxLeftCol = columns->cur;
     size_t indentLength = maxLeftCol + 5;
     size_t lineLength = columns->max - indentLength;
@@ -317,38 +694,25 @@ static void singleOptionHelp(FILE * fp, columns_t columns,
     const char * argDescrip = getArgDescrip(opt, translation_domain);
     /* Display shortName iff printable non-space. */
     int prtshort = (int)(isprint((int)opt->shortName) && opt->shortName != ' ');
+    int prtdefs = 0;
     size_t helpLength;
-    char * defs = NULL;
-    char * left;
-    size_t nb = maxLeftCol + 1;
-    int displaypad = 0;
-    int xx;
-
-    /* Make sure there's more than enough room in target buffer. */
-    if (opt->longName)	nb += strlen(opt->longName);
-    if (F_ISSET(opt, TOGGLE)) nb += sizeof("[no]") - 1;
-    if (argDescrip)	nb += strlen(argDescrip);
-
-    left = malloc(nb);
-    if (left == NULL) return;	/* XXX can't happen */
-    left[0] = '\0';
-    left[maxLeftCol] = '\0';
+    size_t left;
+    size_t leftWidth;
 
 #define	prtlong	(opt->longName != NULL)	/* XXX splint needs a clue */
     if (!(prtshort || prtlong))
-	goto out;
+	return;
+
+    bufPuts(ob, "  ");
+    left = ob->nb;
     if (prtshort && prtlong) {
-	char *dash = F_ISSET(opt, ONEDASH) ? "-" : "--";
-	left[0] = '-';
-	left[1] = opt->shortName;
-	(void) stpcpy(stpcpy(stpcpy(left+2, ", "), dash), opt->longName);
+	const char *dash = F_ISSET(opt, ONEDASH) ? "-" : "--";
+	bufPrintf(ob, "-%c, %s%s", opt->shortName, dash, opt->longName);
     } else if (prtshort) {
-	left[0] = '-';
-	left[1] = opt->shortName;
-	left[2] = '\0';
+	bufPrintf(ob, "-%c", opt->shortName);
     } else if (prtlong) {
 	/* XXX --long always padded for alignment with/without "-X, ". */
-	char *dash = poptArgType(opt) == POPT_ARG_MAINCALL ? ""
+	const char *dash = poptArgType(opt) == POPT_ARG_MAINCALL ? ""
 		   : (F_ISSET(opt, ONEDASH) ? "-" : "--");
 	const char *longName = opt->longName;
 	const char *toggle;
@@ -361,33 +725,17 @@ static void singleOptionHelp(FILE * fp, columns_t columns,
 	    }
 	} else
 	    toggle = "";
-	(void) stpcpy(stpcpy(stpcpy(stpcpy(left, "    "), dash), toggle), longName);
+	bufPrintf(ob, "    %s%s%s", dash, toggle, longName);
     }
 #undef	prtlong
 
     if (argDescrip) {
-	char * le = left + strlen(left);
-
 	if (F_ISSET(opt, OPTIONAL))
-	    *le++ = '[';
+	    bufPutc(ob, '[');
 
 	/* Choose type of output */
-	if (F_ISSET(opt, SHOW_DEFAULT)) {
-	    defs = singleOptionDefaultValue(lineLength, opt, translation_domain);
-	    if (defs) {
-		char * t = malloc((help ? strlen(help) : 0) +
-				strlen(defs) + sizeof(" "));
-		if (t) {
-		    char * te = t;
-		    if (help)
-			te = stpcpy(te, help);
-		    *te++ = ' ';
-		    strcpy(te, defs);
-		    defs = _free(defs);
-		    defs = t;
-		}
-	    }
-	}
+	if (F_ISSET(opt, SHOW_DEFAULT))
+	    prtdefs = 1;
 
 	if (opt->argDescrip == NULL) {
 	    switch (poptArgType(opt)) {
@@ -402,26 +750,26 @@ static void singleOptionHelp(FILE * fp, columns_t columns,
 		/* Don't bother displaying typical values */
 		if (!ops && (aLong == 0L || aLong == 1L || aLong == -1L))
 		    break;
-		*le++ = '[';
+		bufPutc(ob, '[');
 		switch (ops) {
 		case POPT_ARGFLAG_OR:
-		    *le++ = '|';
+		    bufPutc(ob, '|');
 		    /*@innerbreak@*/ break;
 		case POPT_ARGFLAG_AND:
-		    *le++ = '&';
+		    bufPutc(ob, '&');
 		    /*@innerbreak@*/ break;
 		case POPT_ARGFLAG_XOR:
-		    *le++ = '^';
+		    bufPutc(ob, '^');
 		    /*@innerbreak@*/ break;
 		default:
 		    /*@innerbreak@*/ break;
 		}
-		*le++ = (opt->longName != NULL ? '=' : ' ');
-		if (negate) *le++ = '~';
+		bufPutc(ob, (opt->longName != NULL ? '=' : ' '));
+		if (negate) bufPutc(ob, '~');
 		/*@-formatconst@*/
-		le += sprintf(le, (ops ? "0x%lx" : "%ld"), aLong);
+		bufPrintf(ob, (ops ? "0x%lx" : "%ld"), aLong);
 		/*@=formatconst@*/
-		*le++ = ']';
+		bufPutc(ob, ']');
 	    }
 #endif
 		break;
@@ -432,82 +780,87 @@ static void singleOptionHelp(FILE * fp, columns_t columns,
 	    case POPT_ARG_FLOAT:
 	    case POPT_ARG_DOUBLE:
 	    case POPT_ARG_STRING:
-		*le++ = (opt->longName != NULL ? '=' : ' ');
-		le = stpcpy(le, argDescrip);
+		bufPutc(ob, (opt->longName != NULL ? '=' : ' '));
+		bufPuts(ob, argDescrip);
 		break;
 	    default:
 		break;
 	    }
 	} else {
-	    char *leo;
-
 	    /* XXX argDescrip[0] determines "--foo=bar" or "--foo bar". */
 	    if (!strchr(" =(", argDescrip[0]))
-		*le++ = ((poptArgType(opt) == POPT_ARG_MAINCALL) ? ' ' :
-			 (poptArgType(opt) == POPT_ARG_ARGV) ? ' ' : '=');
-	    le = stpcpy(leo = le, argDescrip);
-
-	    /* Adjust for (possible) wide characters. */
-	    displaypad = (int)((le - leo) - stringDisplayWidth(argDescrip));
+		bufPutc(ob, ((poptArgType(opt) == POPT_ARG_MAINCALL) ? ' ' :
+			 (poptArgType(opt) == POPT_ARG_ARGV) ? ' ' : '='));
+	    bufPuts(ob, argDescrip);
 	}
 	if (F_ISSET(opt, OPTIONAL))
-	    *le++ = ']';
-	*le = '\0';
+	    bufPutc(ob, ']');
     }
 
-    if (help)
-	xx = POPT_fprintf(fp,"  %-*s   ", (int)(maxLeftCol+displaypad), left);
-    else {
-	xx = POPT_fprintf(fp,"  %s\n", left); 
-	goto out;
+    if (help == NULL) {
+	bufPutc(ob, '\n');
+	return;
     }
 
-    left = _free(left);
-    if (defs)
-	help = defs;
+    /* Pad the left column by display width, for wide characters. */
+    leftWidth = (ob->err ? 0 : stringDisplayWidthN(ob->b + left, ob->nb - left));
+    bufPad(ob, (leftWidth < maxLeftCol ? maxLeftCol - leftWidth : 0) + 3);
+
+    if (prtdefs) {
+	poptBuf tb = &hb->tmp;
+
+	tb->nb = 0;
+	bufPuts(tb, help);
+	bufPutc(tb, ' ');
+	if (singleOptionDefaultValue(tb, lineLength, opt, translation_domain) == 0
+	 && !tb->err)
+	    help = tb->b;
+    }
 
-    helpLength = strlen(help);
+    /* Wrap the help text in place, no copies needed to terminate lines. */
+    helpLength = stringDisplayWidth(help);
     while (helpLength > lineLength) {
 	const char * ch;
-	char format[16];
-
-	ch = help + lineLength - 1;
-	while (ch > help && !_isspaceptr(ch))
-	    ch = POPT_prev_char(ch);
-	if (ch == help) break;		/* give up */
-	while (ch > (help + 1) && _isspaceptr(ch))
-	    ch = POPT_prev_char (ch);
-	ch = POPT_next_char(ch);
-
-	/*
-	 *  XXX strdup is necessary to add NUL terminator so that an unknown
-	 *  no. of (possible) multi-byte characters can be displayed.
-	 */
-	{   char * fmthelp = xstrdup(help);
-	    if (fmthelp) {
-		fmthelp[ch - help] = '\0';
-		sprintf(format, "%%s\n%%%ds", (int) indentLength);
-		/*@-formatconst@*/
-		xx = POPT_fprintf(fp, format, fmthelp, " ");
-		/*@=formatconst@*/
-		free(fmthelp);
-	    }
+	const char * end = stringDisplayPrefix(help, lineLength);
+	int wide = 0;
+
+	/* East Asian text may break after any wide character. */
+	if (end > help && (*(const unsigned char *)POPT_prev_char(end)) >= 0x80) {
+	    const char * pc = POPT_prev_char(end);
+	    uint32_t c;
+	    wide = (utf8Decode((const unsigned char *)pc, (size_t)(end - pc), &c)
+			== (size_t)(end - pc) && codePointWidth(c) == 2);
 	}
 
+	if (wide)
+	    ch = end;
+	else {
+	    /* Start at the last character that fits in lineLength columns. */
+	    ch = end;
+	    if (ch > help)
+		ch = POPT_prev_char(ch);
+	    while (ch > help && !_isspaceptr(ch))
+		ch = POPT_prev_char(ch);
+	    if (ch == help) break;		/* give up */
+	    while (ch > (help + 1) && _isspaceptr(ch))
+		ch = POPT_prev_char (ch);
+	    ch = POPT_next_char(ch);
+	}
+
+	bufPutn(ob, help, (size_t)(ch - help));
+	bufPutc(ob, '\n');
+	bufPad(ob, indentLength);
+
 	help = ch;
 	while (_isspaceptr(help) && *help)
 	    help = POPT_next_char(help);
-	helpLength = strlen(help);
+	helpLength = stringDisplayWidth(help);
     }
 
-    if (helpLength) fprintf(fp, "%s\n", help);
-    help = NULL;
-
-out:
-    /*@-dependenttrans@*/
-    defs = _free(defs);
-    /*@=dependenttrans@*/
-    left = _free(left);
+    if (*help) {
+	bufPuts(ob, help);
+	bufPutc(ob, '\n');
+    }
 }
 
 /**
@@ -536,7 +889,7 @@ static size_t maxArgWidth(const struct poptOption * opt,
 	    len += sizeof("-X, ")-1;
 	    if (opt->longName) {
 		len += (F_ISSET(opt, ONEDASH) ? sizeof("-") : sizeof("--")) - 1;
-		len += strlen(opt->longName);
+		len += stringDisplayWidth(opt->longName);
 	    }
 
 	    argDescrip = getArgDescrip(opt, translation_domain);
@@ -561,18 +914,17 @@ static size_t maxArgWidth(const struct poptOption * opt,
 
 /**
  * Display popt alias and exec help.
- * @param fp		output file handle
+ * @param hb		help buffers
  * @param items		alias/exec array
  * @param nitems	no. of alias/exec entries
  * @param columns	output display width control
  * @param translation_domain	translation domain
  */
-static void itemHelp(FILE * fp,
+static void itemHelp(poptHelpBuf hb,
 		/*@null@*/ poptItem items, int nitems,
 		columns_t columns,
 		/*@null@*/ const char * translation_domain)
-	/*@globals fileSystem @*/
-	/*@modifies fp, fileSystem @*/
+	/*@modifies hb @*/
 {
     poptItem item;
     int i;
@@ -582,39 +934,83 @@ static void itemHelp(FILE * fp,
 	const struct poptOption * opt;
 	opt = &item->option;
 	if ((opt->longName || opt->shortName) && !F_ISSET(opt, DOC_HIDDEN))
-	    singleOptionHelp(fp, columns, opt, translation_domain);
+	    singleOptionHelp(hb, columns, opt, translation_domain);
+    }
+}
+
+#if defined(ENABLE_NLS) && defined(HAVE_DCGETTEXT) && !defined(__LCLINT__)
+/**
+ * Translate the help strings of a table up front, so that the domain
+ * codeset is rebound once per table rather than once per string.
+ * @param table		option(s)
+ * @param translation_domain	translation domain
+ */
+static void primeTableI18N(const struct poptOption * table,
+		/*@null@*/ const char * translation_domain)
+	/*@*/
+{
+    const struct poptOption * opt;
+    const char ** strv;
+    size_t n = 0;
+
+    for (opt = table; opt->longName || opt->shortName || opt->arg; opt++)
+	n++;
+    if (n == 0 || (strv = malloc(2 * n * sizeof(*strv))) == NULL)
+	return;
+
+    n = 0;
+    for (opt = table; opt->longName || opt->shortName || opt->arg; opt++) {
+	if (F_ISSET(opt, DOC_HIDDEN))
+	    continue;
+	switch (poptArgType(opt)) {
+	case POPT_ARG_INCLUDE_TABLE:	/* translated in the sub-table domain */
+	    continue;
+	case POPT_ARG_MAINCALL:
+	case POPT_ARG_ARGV:		/* argDescrip isn't translated */
+	    break;
+	default:
+	    strv[n++] = opt->argDescrip;
+	    break;
+	}
+	strv[n++] = opt->descrip;
     }
+    POPT_dgettext_prime(translation_domain, strv, n);
+    free(strv);
 }
+#else
+#define	primeTableI18N(table, translation_domain)	do { } while (0)
+#endif
 
 /**
  * Display help text for a table of options.
  * @param con		context
- * @param fp		output file handle
+ * @param hb		help buffers
  * @param table		option(s)
  * @param columns	output display width control
  * @param translation_domain	translation domain
  */
-static void singleTableHelp(poptContext con, FILE * fp,
+static void singleTableHelp(poptContext con, poptHelpBuf hb,
 		/*@null@*/ const struct poptOption * table,
 		columns_t columns,
 		/*@null@*/ const char * translation_domain)
-	/*@globals fileSystem @*/
-	/*@modifies fp, columns->cur, fileSystem @*/
+	/*@modifies hb, columns->cur @*/
 {
     const struct poptOption * opt;
     const char *sub_transdom;
-    int xx;
 
     if (table == poptAliasOptions) {
-	itemHelp(fp, con->aliases, con->numAliases, columns, NULL);
-	itemHelp(fp, con->execs, con->numExecs, columns, NULL);
+	itemHelp(hb, con->aliases, con->numAliases, columns, NULL);
+	itemHelp(hb, con->execs, con->numExecs, columns, NULL);
 	return;
     }
 
+    if (table != NULL)
+	primeTableI18N(table, translation_domain);
+
     if (table != NULL)
     for (opt = table; opt->longName || opt->shortName || opt->arg; opt++) {
 	if ((opt->longName || opt->shortName) && !F_ISSET(opt, DOC_HIDDEN))
-	    singleOptionHelp(fp, columns, opt, translation_domain);
+	    singleOptionHelp(hb, columns, opt, translation_domain);
     }
 
     if (table != NULL)
@@ -629,68 +1025,132 @@ static void singleTableHelp(poptContext con, FILE * fp,
 	if (opt->arg == poptAliasOptions && !(con->numAliases || con->numExecs))
 	    continue;
 	if (opt->descrip)
-	    xx = POPT_fprintf(fp, "\n%s\n", D_(sub_transdom, opt->descrip));
+	    bufPrintf(&hb->out, "\n%s\n", D_(sub_transdom, opt->descrip));
 
-	singleTableHelp(con, fp, opt->arg, columns, sub_transdom);
+	singleTableHelp(con, hb, opt->arg, columns, sub_transdom);
     }
 }
 
 /**
  * @param con		context
- * @param fp		output file handle
+ * @param ob		output buffer
  */
-static size_t showHelpIntro(poptContext con, FILE * fp)
-	/*@globals fileSystem @*/
-	/*@modifies fp, fileSystem @*/
+static size_t showHelpIntro(poptContext con, poptBuf ob)
+	/*@modifies ob @*/
 {
     size_t len = (size_t)6;
-    int xx;
 
-    xx = POPT_fprintf(fp, POPT_("Usage:"));
+    bufPuts(ob, POPT_("Usage:"));
     if (!(con->flags & POPT_CONTEXT_KEEP_FIRST)) {
 	struct optionStackEntry * os = con->optionStack;
 	const char * fn = (os->argv ? os->argv[0] : NULL);
 	if (fn == NULL) return len;
 	if (strchr(fn, '/')) fn = strrchr(fn, '/') + 1;
-	/* XXX POPT_fprintf not needed for argv[0] display. */
-	fprintf(fp, " %s", fn);
-	len += strlen(fn) + 1;
+	/* XXX non-UTF-8 argv[0] bytes pass through POPT_fwrite unchanged. */
+	bufPrintf(ob, " %s", fn);
+	len += stringDisplayWidth(fn) + 1;
     }
 
     return len;
 }
 
-void poptPrintHelp(poptContext con, FILE * fp, /*@unused@*/ UNUSED(int flags))
+/**
+ * Find the prerendered text for an output width, if it applies.
+ * @param con		context
+ * @param maxcols	output width
+ * @return		prerendered text, NULL to render dynamically
+ */
+static /*@null@*/ /*@observer@*/ const struct poptPrerendered *
+findPrerendered(poptContext con, size_t maxcols)
+	/*@*/
 {
-    columns_t columns = calloc((size_t)1, sizeof(*columns));
-    int xx;
+    const struct poptPrerendered * pr = con->prerendered;
+    const char * fn = "";
+
+    /* Aliases, execs and other option help change the text. */
+    if (pr == NULL || con->numAliases > 0 || con->numExecs > 0
+     || con->otherHelp != NULL)
+	return NULL;
+#if defined(ENABLE_NLS) && defined(HAVE_DCGETTEXT) && defined(LC_MESSAGES)
+    /* The text is rendered untranslated. */
+    {	const char * locale = setlocale(LC_MESSAGES, NULL);
+	if (locale == NULL || (strcmp(locale, "C") && strcmp(locale, "POSIX")))
+	    return NULL;
+    }
+#endif
+
+    /* Same as showHelpIntro(). */
+    if (!(con->flags & POPT_CONTEXT_KEEP_FIRST)) {
+	struct optionStackEntry * os = con->optionStack;
+	fn = (os->argv ? os->argv[0] : NULL);
+	if (fn == NULL)
+	    fn = "";
+	else if (strchr(fn, '/'))
+	    fn = strrchr(fn, '/') + 1;
+    }
+
+    for (; pr->argv0 != NULL; pr++) {
+	if ((size_t)pr->columns == maxcols && !strcmp(pr->argv0, fn))
+	    return pr;
+    }
+    return NULL;
+}
 
-    (void) showHelpIntro(con, fp);
+/**
+ * Render detailed description of options into the help buffer.
+ * @param con		context
+ * @param maxcols	output width
+ */
+static void renderHelp(poptContext con, size_t maxcols)
+	/*@modifies con @*/
+{
+    struct columns_s columns_buf;
+    columns_t columns = &columns_buf;
+    poptHelpBuf hb = &con->helpBuf;
+
+    (void) showHelpIntro(con, &hb->out);
     if (con->otherHelp)
-	xx = POPT_fprintf(fp, " %s\n", con->otherHelp);
+	bufPrintf(&hb->out, " %s\n", con->otherHelp);
     else
-	xx = POPT_fprintf(fp, " %s\n", POPT_("[OPTION...]"));
+	bufPrintf(&hb->out, " %s\n", POPT_("[OPTION...]"));
+
+    columns->cur = maxArgWidth(con->options, NULL);
+    columns->max = maxcols;
+    singleTableHelp(con, hb, con->options, columns, NULL);
+}
+
+void poptPrintHelp(poptContext con, FILE * fp, /*@unused@*/ UNUSED(int flags))
+{
+    size_t maxcols = maxColumnWidth(fp);
+    const struct poptPrerendered * pr = findPrerendered(con, maxcols);
 
-    if (columns) {
-	columns->cur = maxArgWidth(con->options, NULL);
-	columns->max = maxColumnWidth(fp);
-	singleTableHelp(con, fp, con->options, columns, NULL);
-	free(columns);
+    if (pr != NULL && pr->help != NULL) {
+	(void) POPT_fwrite(pr->help, strlen(pr->help), fp);
+	return;
     }
+    renderHelp(con, maxcols);
+    bufFlush(&con->helpBuf, fp);
+}
+
+char * poptHelpString(poptContext con, int columns)
+{
+    if (con == NULL || columns <= 0)
+	return NULL;
+    renderHelp(con, (size_t)columns);
+    return bufTake(&con->helpBuf);
 }
 
 /**
  * Display usage text for an option.
- * @param fp		output file handle
+ * @param ob		output buffer
  * @param columns	output display width control
  * @param opt		option(s)
  * @param translation_domain	translation domain
  */
-static size_t singleOptionUsage(FILE * fp, columns_t columns,
+static size_t singleOptionUsage(poptBuf ob, columns_t columns,
 		const struct poptOption * opt,
 		/*@null@*/ const char *translation_domain)
-	/*@globals fileSystem @*/
-	/*@modifies fp, columns->cur, fileSystem @*/
+	/*@modifies ob, columns->cur @*/
 {
     size_t len = sizeof(" []")-1;
     const char * argDescrip = getArgDescrip(opt, translation_domain);
@@ -707,7 +1167,7 @@ static size_t singleOptionUsage(FILE * fp, columns_t columns,
     if (prtlong) {
 	if (prtshort) len += sizeof("|")-1;
 	len += (F_ISSET(opt, ONEDASH) ? sizeof("-") : sizeof("--")) - 1;
-	len += strlen(opt->longName);
+	len += stringDisplayWidth(opt->longName);
     }
 
     if (argDescrip) {
@@ -720,15 +1180,15 @@ static size_t singleOptionUsage(FILE * fp, columns_t columns,
     }
 
     if ((columns->cur + len) > columns->max) {
-	fprintf(fp, "\n       ");
+	bufPuts(ob, "\n       ");
 	columns->cur = (size_t)7;
     } 
 
-    fprintf(fp, " [");
+    bufPuts(ob, " [");
     if (prtshort)
-	fprintf(fp, "-%c", opt->shortName);
+	bufPrintf(ob, "-%c", opt->shortName);
     if (prtlong)
-	fprintf(fp, "%s%s%s",
+	bufPrintf(ob, "%s%s%s",
 		(prtshort ? "|" : ""),
 		(F_ISSET(opt, ONEDASH) ? "-" : "--"),
 		opt->longName);
@@ -736,27 +1196,26 @@ static size_t singleOptionUsage(FILE * fp, columns_t columns,
 
     if (argDescrip) {
 	/* XXX argDescrip[0] determines "--foo=bar" or "--foo bar". */
-	if (!strchr(" =(", argDescrip[0])) fprintf(fp, "=");
-	fprintf(fp, "%s", argDescrip);
+	if (!strchr(" =(", argDescrip[0])) bufPutc(ob, '=');
+	bufPuts(ob, argDescrip);
     }
-    fprintf(fp, "]");
+    bufPutc(ob, ']');
 
     return columns->cur + len + 1;
 }
 
 /**
  * Display popt alias and exec usage.
- * @param fp		output file handle
+ * @param ob		output buffer
  * @param columns	output display width control
  * @param item		alias/exec array
  * @param nitems	no. of ara/exec entries
  * @param translation_domain	translation domain
  */
-static size_t itemUsage(FILE * fp, columns_t columns,
+static size_t itemUsage(poptBuf ob, columns_t columns,
 		/*@null@*/ poptItem item, int nitems,
 		/*@null@*/ const char * translation_domain)
-	/*@globals fileSystem @*/
-	/*@modifies fp, columns->cur, fileSystem @*/
+	/*@modifies ob, columns->cur @*/
 {
     int i;
 
@@ -768,7 +1227,7 @@ static size_t itemUsage(FILE * fp, columns_t columns,
 	    translation_domain = (const char *)opt->arg;
 	} else
 	if ((opt->longName || opt->shortName) && !F_ISSET(opt, DOC_HIDDEN)) {
-	    columns->cur = singleOptionUsage(fp, columns, opt, translation_domain);
+	    columns->cur = singleOptionUsage(ob, columns, opt, translation_domain);
 	}
     }
 
@@ -776,31 +1235,97 @@ static size_t itemUsage(FILE * fp, columns_t columns,
 }
 
 /**
- * Keep track of option tables already processed.
+ * Keep track of option tables already processed: an open addressing set
+ * of table pointers, so that deeply composed tables are rendered once each.
  */
 typedef struct poptDone_s {
-    int nopts;
-    int maxopts;
-/*@null@*/
+    size_t nopts;		/* no. of tables */
+    size_t nslots;		/* no. of slots, a power of 2 */
+/*@only@*/ /*@null@*/
     const void ** opts;
 } * poptDone;
 
+/**
+ * Return the home slot of an option table: the pointer bits are folded
+ * and multiplied by 2^64/phi, so that tables declared next to each other
+ * spread over the set.
+ * @param opts		option table
+ * @param nslots	no. of slots, a power of 2
+ * @return		slot index
+ */
+static size_t poptDoneHash(const void * opts, size_t nslots)
+	/*@*/
+{
+    uintptr_t h = (uintptr_t)opts;
+    h ^= h >> 17;
+    h *= (uintptr_t)0x9E3779B97F4A7C15ULL;
+    return (size_t)(h >> 7) & (nslots - 1);
+}
+
+/**
+ * Add an option table to the tables already processed.
+ * @param done		tables already processed
+ * @param opts		option table
+ * @return		1 if added, 0 if already there, -1 on malloc failure
+ */
+static int poptDoneAdd(poptDone done, const void * opts)
+	/*@modifies done @*/
+{
+    size_t i;
+
+    if (done->opts != NULL)
+    for (i = poptDoneHash(opts, done->nslots); done->opts[i] != NULL;
+	 i = (i + 1) & (done->nslots - 1))
+    {
+	if (done->opts[i] == opts)
+	    return 0;
+    }
+
+    /* Keep the load at most 1/2. */
+    if (2 * (done->nopts + 1) > done->nslots) {
+	size_t nslots = (done->nslots ? 2 * done->nslots : 64);
+	const void ** slots = calloc(nslots, sizeof(*slots));
+	size_t j;
+
+	if (slots == NULL)
+	    return -1;
+	for (j = 0; j < done->nslots; j++) {
+	    const void * that = done->opts[j];
+	    if (that == NULL)
+		continue;
+	    i = poptDoneHash(that, nslots);
+	    while (slots[i] != NULL)
+		i = (i + 1) & (nslots - 1);
+	    slots[i] = that;
+	}
+	free(done->opts);
+	done->opts = slots;
+	done->nslots = nslots;
+    }
+
+    i = poptDoneHash(opts, done->nslots);
+    while (done->opts[i] != NULL)
+	i = (i + 1) & (done->nslots - 1);
+    done->opts[i] = opts;
+    done->nopts++;
+    return 1;
+}
+
 /**
  * Display usage text for a table of options.
  * @param con		context
- * @param fp		output file handle
+ * @param ob		output buffer
  * @param columns	output display width control
  * @param opt		option(s)
  * @param translation_domain	translation domain
  * @param done		tables already processed
  * @return
  */
-static size_t singleTableUsage(poptContext con, FILE * fp, columns_t columns,
+static size_t singleTableUsage(poptContext con, poptBuf ob, columns_t columns,
 		/*@null@*/ const struct poptOption * opt,
 		/*@null@*/ const char * translation_domain,
 		/*@null@*/ poptDone done)
-	/*@globals fileSystem @*/
-	/*@modifies fp, columns->cur, done, fileSystem @*/
+	/*@modifies ob, columns->cur, done @*/
 {
     if (opt != NULL)
     for (; (opt->longName || opt->shortName || opt->arg) ; opt++) {
@@ -808,26 +1333,15 @@ static size_t singleTableUsage(poptContext con, FILE * fp, columns_t columns,
 	    translation_domain = (const char *)opt->arg;
 	} else
 	if (poptArgType(opt) == POPT_ARG_INCLUDE_TABLE) {
-	    if (done) {
-		int i = 0;
-		if (done->opts != NULL)
-		for (i = 0; i < done->nopts; i++) {
-		    const void * that = done->opts[i];
-		    if (that == NULL || that != opt->arg)
-			/*@innercontinue@*/ continue;
-		    /*@innerbreak@*/ break;
-		}
-		/* Skip if this table has already been processed. */
-		if (opt->arg == NULL || i < done->nopts)
-		    continue;
-		if (done->opts != NULL && done->nopts < done->maxopts)
-		    done->opts[done->nopts++] = (const void *) opt->arg;
-	    }
-	    columns->cur = singleTableUsage(con, fp, columns, opt->arg,
+	    /* Skip if this table has already been processed. */
+	    if (opt->arg == NULL
+	     || (done != NULL && poptDoneAdd(done, opt->arg) == 0))
+		continue;
+	    columns->cur = singleTableUsage(con, ob, columns, opt->arg,
 			translation_domain, done);
 	} else
 	if ((opt->longName || opt->shortName) && !F_ISSET(opt, DOC_HIDDEN)) {
-	    columns->cur = singleOptionUsage(fp, columns, opt, translation_domain);
+	    columns->cur = singleOptionUsage(ob, columns, opt, translation_domain);
 	}
     }
 
@@ -838,14 +1352,13 @@ static size_t singleTableUsage(poptContext con, FILE * fp, columns_t columns,
  * Return concatenated short options for display.
  * @todo Sub-tables should be recursed.
  * @param opt		option(s)
- * @param fp		output file handle
+ * @param ob		output buffer
  * @retval str		concatenation of short options
  * @return		length of display string
  */
-static size_t showShortOptions(const struct poptOption * opt, FILE * fp,
+static size_t showShortOptions(const struct poptOption * opt, poptBuf ob,
 		/*@null@*/ char * str)
-	/*@globals fileSystem @*/
-	/*@modifies str, *fp, fileSystem @*/
+	/*@modifies str, ob @*/
 	/*@requires maxRead(str) >= 0 @*/
 {
     /* bufsize larger then the ascii set, lazy allocation on top level call. */
@@ -866,12 +1379,12 @@ static size_t showShortOptions(const struct poptOption * opt, FILE * fp,
 		s[strlen(s)] = opt->shortName;
 	} else if (poptArgType(opt) == POPT_ARG_INCLUDE_TABLE)
 	    if (opt->arg)	/* XXX program error */
-		len = showShortOptions(opt->arg, fp, s);
+		len = showShortOptions(opt->arg, ob, s);
     } 
 
     /* On return to top level, print the short options, return print length. */
     if (s != str && *s != '\0') {
-	fprintf(fp, " [-%s]", s);
+	bufPrintf(ob, " [-%s]", s);
 	len = strlen(s) + sizeof(" [-]")-1;
     }
 /*@-temptrans@*/	/* LCL: local s, not str arg, is being freed. */
@@ -881,43 +1394,70 @@ static size_t showShortOptions(const struct poptOption * opt, FILE * fp,
     return len;
 }
 
-void poptPrintUsage(poptContext con, FILE * fp, /*@unused@*/ UNUSED(int flags))
+/**
+ * Render terse description of options into the help buffer.
+ * @param con		context
+ * @param maxcols	output width
+ */
+static void renderUsage(poptContext con, size_t maxcols)
+	/*@modifies con @*/
 {
     columns_t columns = calloc((size_t)1, sizeof(*columns));
+    poptBuf ob = &con->helpBuf.out;
     struct poptDone_s done_buf;
     poptDone done = &done_buf;
 
     memset(done, 0, sizeof(*done));
-    done->nopts = 0;
-    done->maxopts = 64;
   if (columns) {
-    columns->cur = done->maxopts * sizeof(*done->opts);
-    columns->max = maxColumnWidth(fp);
-    done->opts = calloc((size_t)1, columns->cur);
-    /*@-keeptrans@*/
-    if (done->opts != NULL)
-	done->opts[done->nopts++] = (const void *) con->options;
-    /*@=keeptrans@*/
+    columns->max = maxcols;
+    (void) poptDoneAdd(done, con->options);
 
-    columns->cur = showHelpIntro(con, fp);
-    columns->cur += showShortOptions(con->options, fp, NULL);
-    columns->cur = singleTableUsage(con, fp, columns, con->options, NULL, done);
-    columns->cur = itemUsage(fp, columns, con->aliases, con->numAliases, NULL);
-    columns->cur = itemUsage(fp, columns, con->execs, con->numExecs, NULL);
+    columns->cur = showHelpIntro(con, ob);
+    columns->cur += showShortOptions(con->options, ob, NULL);
+    columns->cur = singleTableUsage(con, ob, columns, con->options, NULL, done);
+    columns->cur = itemUsage(ob, columns, con->aliases, con->numAliases, NULL);
+    columns->cur = itemUsage(ob, columns, con->execs, con->numExecs, NULL);
 
     if (con->otherHelp) {
-	columns->cur += strlen(con->otherHelp) + 1;
-	if (columns->cur > columns->max) fprintf(fp, "\n       ");
-	fprintf(fp, " %s", con->otherHelp);
+	columns->cur += stringDisplayWidth(con->otherHelp) + 1;
+	if (columns->cur > columns->max) bufPuts(ob, "\n       ");
+	bufPrintf(ob, " %s", con->otherHelp);
     }
 
-    fprintf(fp, "\n");
+    bufPutc(ob, '\n');
     if (done->opts != NULL)
 	free(done->opts);
     free(columns);
   }
 }
 
+void poptPrintUsage(poptContext con, FILE * fp, /*@unused@*/ UNUSED(int flags))
+{
+    size_t maxcols = maxColumnWidth(fp);
+    const struct poptPrerendered * pr = findPrerendered(con, maxcols);
+
+    if (pr != NULL && pr->usage != NULL) {
+	(void) POPT_fwrite(pr->usage, strlen(pr->usage), fp);
+	return;
+    }
+    renderUsage(con, maxcols);
+    bufFlush(&con->helpBuf, fp);
+}
+
+char * poptUsageString(poptContext con, int columns)
+{
+    if (con == NULL || columns <= 0)
+	return NULL;
+    renderUsage(con, (size_t)columns);
+    return bufTake(&con->helpBuf);
+}
+
+void poptSetPrerendered(poptContext con, const struct poptPrerendered * table)
+{
+    if (con)
+	con->prerendered = table;
+}
+
 void poptSetOtherOptionHelp(poptContext con, const char * text)
 {
     con->otherHelp = _free(con->otherHelp);
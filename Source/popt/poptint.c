@@ -5,8 +5,15 @@
 /* Any pair of 32 bit hashes can be used. lookup3.c generates pairs, will do. */
 #define _JLU3_jlu32lpair        1
 #define	jlu32lpair	poptJlu32lpair
+#define	_JLU3_jlu32lpairN	1
+#define	jlu32lpairN	poptJlu32lpairN
 #include "lookup3.c"
 
+/* XXH64 reads 32 bytes a round, for bit sets made with POPT_BITS_XXH64. */
+#define	_XXH64_xxh64pair	1
+#define	xxh64pair	poptXxh64pair
+#include "xxh64.c"
+
 /*@-varuse +charint +ignoresigns @*/
 /*@unchecked@*/ /*@observer@*/
 static const unsigned char utf8_skip_data[256] = {
@@ -48,151 +55,500 @@ POPT_next_char (const char *str)
 
 #if !defined(POPT_fprintf)	/* XXX lose all the goop ... */
 
+#include <pthread.h>
+
 #if defined(HAVE_DCGETTEXT) && !defined(__LCLINT__)
+#include <locale.h>
+
+/**
+ * Memoized UTF-8 translations of one text domain, keyed by msgid text.
+ * Some msgids are on the heap (e.g. config file alias descriptions), so
+ * the memo keeps its own copy of each msgid, and a msgid without a
+ * translation is memoized as NULL rather than as the caller's pointer.
+ */
+struct poptI18NDomain_s {
+/*@only@*/ /*@null@*/
+    struct poptI18NDomain_s * next;
+/*@only@*/
+    char * dom;
+#if defined(__GLIBC__)
+    int catalogs;		/* _nl_msg_cat_cntr the translations are for */
+#else
+/*@only@*/ /*@null@*/
+    char * locale;		/* LC_MESSAGES the translations are for */
+/*@only@*/ /*@null@*/
+    char * language;		/* $LANGUAGE the translations are for */
+/*@only@*/ /*@null@*/
+    char * dirname;		/* bindtextdomain() the translations are for */
+#endif
+/*@only@*/ /*@null@*/
+    const char ** slots;	/* msgid copy, translation (or NULL) pairs */
+    size_t nslots;		/* no. of pairs, a power of 2 */
+    size_t nused;
+};
+
+/*@unchecked@*/ /*@only@*/ /*@null@*/
+static struct poptI18NDomain_s * poptI18NDomains;
+/*@unchecked@*/
+static pthread_mutex_t poptI18NLock = PTHREAD_MUTEX_INITIALIZER;
+
+#if defined(__GLIBC__)
+/* Bumped by glibc on each setlocale(), binding change and catalog load. */
+extern int _nl_msg_cat_cntr;
+#endif
+
+static size_t poptI18NHash(const char * str, size_t nslots)
+	/*@*/
+{
+    uint32_t h0 = 0;
+    uint32_t h1 = 0;
+
+    poptJlu32lpair(str, strlen(str), &h0, &h1);
+    return (size_t)h0 & (nslots - 1);
+}
+
+#if defined(__GLIBC__)
+/**
+ * Note whether the translations of a memo table may have changed.
+ * @param d		memo table
+ * @return		1 if the memo is stale, 0 otherwise
+ */
+static int poptI18NStale(struct poptI18NDomain_s * d)
+	/*@modifies d @*/
+{
+    if (d->catalogs == _nl_msg_cat_cntr)
+	return 0;
+    d->catalogs = _nl_msg_cat_cntr;
+    return 1;
+}
+#else
+/**
+ * Compare (possibly NULL) strings for equality.
+ * @param a		1st string
+ * @param b		2nd string
+ * @return		1 if equal, 0 otherwise
+ */
+static int poptI18NSame(/*@null@*/ const char * a, /*@null@*/ const char * b)
+	/*@*/
+{
+    if (a == NULL || b == NULL)
+	return (a == b);
+    return (strcmp(a, b) == 0);
+}
+
+/**
+ * Replace a (possibly NULL) string with a copy of another.
+ * @retval *ap		string
+ * @param b		new string
+ * @return		0 on success, -1 on malloc failure
+ */
+static int poptI18NSet(char ** ap, /*@null@*/ const char * b)
+	/*@modifies *ap @*/
+{
+    *ap = _free(*ap);
+    if (b != NULL && (*ap = strdup(b)) == NULL)
+	return -1;
+    return 0;
+}
+
+/**
+ * Note whether the translations of a memo table may have changed: whether
+ * the locale, $LANGUAGE or the catalog directory did.
+ * @param d		memo table
+ * @return		1 if the memo is stale, 0 otherwise
+ */
+static int poptI18NStale(struct poptI18NDomain_s * d)
+	/*@modifies d @*/
+{
+    const char * locale = NULL;
+    const char * language = getenv("LANGUAGE");
+    const char * dirname = bindtextdomain(d->dom, NULL);
+
+#ifdef LC_MESSAGES
+    locale = setlocale(LC_MESSAGES, NULL);
+#endif
+    if (locale == NULL)
+	locale = "";
+    if (d->locale != NULL && strcmp(d->locale, locale) == 0
+     && poptI18NSame(d->language, language)
+     && poptI18NSame(d->dirname, dirname))
+	return 0;
+    /* On malloc failure, d->locale stays NULL: stale again next time. */
+    if (poptI18NSet(&d->language, language)
+     || poptI18NSet(&d->dirname, dirname)
+     || poptI18NSet(&d->locale, locale))
+	d->locale = _free(d->locale);
+    return 1;
+}
+#endif
+
+/**
+ * Return the memo table of a domain, emptied if its translations may
+ * have changed.
+ * @param dom		text domain
+ * @return		memo table (NULL on malloc failure)
+ */
+static /*@null@*/ struct poptI18NDomain_s * poptI18NDomain(const char * dom)
+	/*@globals poptI18NDomains @*/
+	/*@modifies poptI18NDomains @*/
+{
+    struct poptI18NDomain_s * d;
+
+    for (d = poptI18NDomains; d != NULL; d = d->next) {
+	if (strcmp(d->dom, dom) == 0)
+	    break;
+    }
+    if (d == NULL) {
+	if ((d = calloc(1, sizeof(*d))) == NULL
+	 || (d->dom = strdup(dom)) == NULL)
+	    return _free(d);
+	d->next = poptI18NDomains;
+	poptI18NDomains = d;
+    }
+    if (poptI18NStale(d)) {
+	size_t i;
+
+	for (i = 0; i < d->nslots; i++)
+	    d->slots[2 * i] = _free(d->slots[2 * i]);
+	d->nused = 0;
+    }
+    return d;
+}
+
+/**
+ * Return the memo slot of a msgid: either its pair, or the empty pair
+ * where it belongs. Room for one more pair is made first.
+ * @param d		memo table
+ * @param str		msgid
+ * @return		slot pair (NULL on malloc failure)
+ */
+static /*@null@*/ const char ** poptI18NSlot(struct poptI18NDomain_s * d,
+		const char * str)
+	/*@modifies d @*/
+{
+    size_t mask;
+    size_t i;
+
+    /* Keep the load at most 1/2. */
+    if (2 * (d->nused + 1) > d->nslots) {
+	size_t nslots = (d->nslots ? 2 * d->nslots : 64);
+	const char ** slots = calloc(2 * nslots, sizeof(*slots));
+	size_t j;
+
+	if (slots == NULL)
+	    return NULL;
+	for (j = 0; j < d->nslots; j++) {
+	    const char * key = d->slots[2 * j];
+	    if (key == NULL)
+		continue;
+	    i = poptI18NHash(key, nslots);
+	    while (slots[2 * i] != NULL)
+		i = (i + 1) & (nslots - 1);
+	    slots[2 * i] = key;
+	    slots[2 * i + 1] = d->slots[2 * j + 1];
+	}
+	free(d->slots);
+	d->slots = slots;
+	d->nslots = nslots;
+    }
+
+    mask = d->nslots - 1;
+    for (i = poptI18NHash(str, d->nslots); d->slots[2 * i] != NULL; i = (i + 1) & mask) {
+	if (strcmp(d->slots[2 * i], str) == 0)
+	    break;
+    }
+    return d->slots + 2 * i;
+}
+
+/**
+ * Translate the msgids missing from a memo table, rebinding the domain
+ * to "UTF-8" (and back) once for all of them.
+ * @param d		memo table
+ * @param strv		msgids
+ * @param n		no. of msgids
+ */
+static void poptI18NFill(struct poptI18NDomain_s * d,
+		const char * const * strv, size_t n)
+	/*@modifies d @*/
+{
+    char * codeset = NULL;
+    int rebound = 0;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+	const char ** slot;
+	const char * t;
+	char * key;
+
+	if (strv[i] == NULL || *strv[i] == '\0')
+	    continue;
+	if ((slot = poptI18NSlot(d, strv[i])) == NULL)
+	    break;
+	if (slot[0] != NULL)
+	    continue;
+	if (!rebound) {
+	    codeset = bind_textdomain_codeset(d->dom, NULL);
+	    /* The returned codeset is overwritten by the next bind. */
+	    if (codeset != NULL && (codeset = strdup(codeset)) == NULL)
+		break;
+	    (void) bind_textdomain_codeset(d->dom, "UTF-8");
+	    rebound = 1;
+	}
+	if ((key = strdup(strv[i])) == NULL)
+	    break;
+	t = dgettext(d->dom, strv[i]);
+	slot[0] = key;
+	slot[1] = (t != strv[i] ? t : NULL);
+	d->nused++;
+    }
+    if (rebound) {
+	(void) bind_textdomain_codeset(d->dom, codeset);
+	free(codeset);
+    }
+}
+
 /*
  * Rebind a "UTF-8" codeset for popt's internal use.
  */
 char *
 POPT_dgettext(const char * dom, const char * str)
 {
-    char * codeset = NULL;
+    struct poptI18NDomain_s * d;
     char * retval = NULL;
 
     if (!dom) 
 	dom = textdomain(NULL);
-    codeset = bind_textdomain_codeset(dom, NULL);
-    bind_textdomain_codeset(dom, "UTF-8");
-    retval = dgettext(dom, str);
-    bind_textdomain_codeset(dom, codeset);
+
+    (void) pthread_mutex_lock(&poptI18NLock);
+    if (str != NULL && *str != '\0' && (d = poptI18NDomain(dom)) != NULL) {
+	const char ** slot = poptI18NSlot(d, str);
+	if (slot != NULL && slot[0] == NULL)
+	    poptI18NFill(d, &str, 1);
+	if (slot != NULL && slot[0] != NULL)
+	    retval = (char *) (slot[1] != NULL ? slot[1] : str);
+    }
+    (void) pthread_mutex_unlock(&poptI18NLock);
+
+    if (retval == NULL) {
+	char * codeset = bind_textdomain_codeset(dom, NULL);
+	bind_textdomain_codeset(dom, "UTF-8");
+	retval = dgettext(dom, str);
+	bind_textdomain_codeset(dom, codeset);
+    }
 
     return retval;
 }
+
+void
+POPT_dgettext_prime(const char * dom, const char * const * strv, size_t n)
+{
+    struct poptI18NDomain_s * d;
+
+    if (!dom)
+	dom = textdomain(NULL);
+
+    (void) pthread_mutex_lock(&poptI18NLock);
+    if ((d = poptI18NDomain(dom)) != NULL)
+	poptI18NFill(d, strv, n);
+    (void) pthread_mutex_unlock(&poptI18NLock);
+}
+#endif
+
+/**
+ * POPT_fprintf() state, kept across calls: buffers that only ever grow,
+ * and the iconv descriptor for the locale codeset it was opened for.
+ */
+struct poptFprintf_s {
+/*@only@*/ /*@null@*/
+    char * b;			/* formatted (UTF-8) text */
+    size_t nb;
+#ifdef HAVE_ICONV
+/*@only@*/ /*@null@*/
+    char * ob;			/* text converted to the locale codeset */
+    size_t nob;
+    char codeset[64];		/* codeset cd converts to, "" if none */
+    iconv_t cd;
 #endif
+};
 
+/*@unchecked@*/
+static struct poptFprintf_s poptFprintfState = {
+    NULL, 0,
 #ifdef HAVE_ICONV
+    NULL, 0, "", (iconv_t)-1,
+#endif
+};
+/*@unchecked@*/
+static pthread_mutex_t poptFprintfLock = PTHREAD_MUTEX_INITIALIZER;
+
 /**
- * Return malloc'd string converted from UTF-8 to current locale.
- * @param istr		input string (UTF-8 encoding assumed)
- * @return		localized string
+ * Make room for at least n bytes in a growable buffer.
+ * @param bp		buffer address
+ * @param nbp		buffer size address
+ * @param n		no. of bytes needed
+ * @return		0 on success, -1 on malloc failure
  */
-static /*@only@*/ /*@null@*/ char *
-strdup_locale_from_utf8 (/*@null@*/ char * istr)
-	/*@*/
+static int poptBufReserve(char ** bp, size_t * nbp, size_t n)
+	/*@modifies *bp, *nbp @*/
 {
-    char * codeset = NULL;
-    char * ostr = NULL;
-    iconv_t cd;
+    size_t nb = *nbp;
+    char * b;
 
-    if (istr == NULL)
-	return NULL;
+    if (n <= nb)
+	return 0;
+    if (nb < 128)
+	nb = 128;
+    while (nb < n)
+	nb *= 2;
+    if ((b = realloc(*bp, nb)) == NULL)
+	return -1;
+    *bp = b;
+    *nbp = nb;
+    return 0;
+}
+
+#ifdef HAVE_ICONV
+/**
+ * Convert UTF-8 text to the current locale codeset.
+ * The codeset is looked up on each call (nl_langinfo(3) only returns a
+ * pointer), but the descriptor is reopened only when it changes.
+ * @param st		POPT_fprintf() state
+ * @param istr		input string (UTF-8 encoding assumed)
+ * @param ni		input string length
+ * @retval *nop		converted string length
+ * @return		converted string (NULL if no conversion is needed)
+ */
+static /*@null@*/ /*@exposed@*/ const char *
+poptConvertFromUTF8(struct poptFprintf_s * st, const char * istr, size_t ni,
+		/*@out@*/ size_t * nop)
+	/*@modifies st, *nop @*/
+{
+    const char * codeset = NULL;
+    char * pin = (char *) istr;
+    char * pout;
+    size_t ib = ni;
+    size_t ob;
 
 #ifdef HAVE_LANGINFO_H
     codeset = nl_langinfo ((nl_item)CODESET);
 #endif
 
-    if (codeset != NULL && strcmp(codeset, "UTF-8") != 0
-     && (cd = iconv_open(codeset, "UTF-8")) != (iconv_t)-1)
-    {
-	char * shift_pin = NULL;
-	size_t db = strlen(istr);
-/*@owned@*/
-	char * dstr = malloc((db + 1) * sizeof(*dstr));
-	char * pin = istr;
-	char * pout = dstr;
-	size_t ib = db;
-	size_t ob = db;
-	size_t err;
-
-	if (dstr == NULL)
+    if (codeset == NULL || strcmp(codeset, "UTF-8") == 0)
+	return NULL;
+    if (strcmp(codeset, st->codeset) != 0) {
+	if (st->cd != (iconv_t)-1)
+	    (void) iconv_close(st->cd);
+	st->cd = (iconv_t)-1;
+	st->codeset[0] = '\0';
+	if (strlen(codeset) >= sizeof(st->codeset)
+	 || (st->cd = iconv_open(codeset, "UTF-8")) == (iconv_t)-1)
 	    return NULL;
-	err = iconv(cd, NULL, NULL, NULL, NULL);
-	while (1) {
-	    *pout = '\0';
-	    err = iconv(cd, &pin, &ib, &pout, &ob);
-	    if (err != (size_t)-1) {
-		if (shift_pin == NULL) {
-		    shift_pin = pin;
-		    pin = NULL;
-		    ib = 0;
-		    continue;
-		}
-	    } else
-	    switch (errno) {
-	    case E2BIG:
-	    {	size_t used = (size_t)(pout - dstr);
-		db *= 2;
-		dstr = realloc(dstr, (db + 1) * sizeof(*dstr));
-		if (dstr != NULL) {
-		    pout = dstr + used;
-		    ob = db - used;
-		    continue;
-		}
-	    }   /*@switchbreak@*/ break;
-	    case EINVAL:
-	    case EILSEQ:
-	    default:
-		/*@switchbreak@*/ break;
-	    }
-	    break;
-	}
-	(void) iconv_close(cd);
-	*pout = '\0';
-	ostr = xstrdup(dstr);
-	free(dstr);
-    } else
-	ostr = xstrdup(istr);
+	(void) strcpy(st->codeset, codeset);
+    }
 
-    return ostr;
+    if (poptBufReserve(&st->ob, &st->nob, ni + 1))
+	return NULL;
+    (void) iconv(st->cd, NULL, NULL, NULL, NULL);
+    pout = st->ob;
+    ob = st->nob - 1;
+    while (1) {
+	/* Convert, then flush the shift state once the input is consumed. */
+	size_t err = (pin != NULL)
+	    ? iconv(st->cd, &pin, &ib, &pout, &ob)
+	    : iconv(st->cd, NULL, NULL, &pout, &ob);
+	if (err != (size_t)-1) {
+	    if (pin == NULL)
+		break;
+	    pin = NULL;
+	    continue;
+	}
+	if (errno != E2BIG && pin != NULL && ib > 0 && ob > 0) {
+	    /* EILSEQ, EINVAL: pass a byte that isn't UTF-8 (argv[0]?) as is. */
+	    *pout++ = *pin++;
+	    ib--;
+	    ob--;
+	    continue;
+	}
+	if (errno == E2BIG || ob == 0) {
+	    size_t used = (size_t)(pout - st->ob);
+	    if (poptBufReserve(&st->ob, &st->nob, 2 * st->nob))
+		break;
+	    pout = st->ob + used;
+	    ob = st->nob - 1 - used;
+	    continue;
+	}
+	break;
+    }
+    *pout = '\0';
+    *nop = (size_t)(pout - st->ob);
+    return st->ob;
 }
 #endif
 
+/**
+ * Write UTF-8 text, converted to the locale codeset (if needed).
+ * @param st		POPT_fprintf() state (locked)
+ * @param s		text
+ * @param ns		no. of bytes
+ * @param stream	output file handle
+ * @return		no. of bytes written, -1 on error
+ */
+static int poptWrite(struct poptFprintf_s * st, const char * s, size_t ns,
+		FILE * stream)
+	/*@globals fileSystem @*/
+	/*@modifies st, stream, fileSystem @*/
+{
+#ifdef HAVE_ICONV
+    size_t nob = 0;
+    const char * os = poptConvertFromUTF8(st, s, ns, &nob);
+
+    if (os != NULL) {
+	s = os;
+	ns = nob;
+    }
+#else
+    (void) st;
+#endif
+    return (fwrite(s, 1, ns, stream) == ns ? (int)ns : -1);
+}
+
 int
 POPT_fprintf (FILE * stream, const char * format, ...)
 {
-    char * b = NULL, * ob = NULL;
-    int rc;
+    struct poptFprintf_s * st = &poptFprintfState;
     va_list ap;
+    int rc;
 
-#if defined(HAVE_VASPRINTF) && !defined(__LCLINT__)
-    va_start(ap, format);
-    if ((rc = vasprintf(&b, format, ap)) < 0)
-	b = NULL;
-    va_end(ap);
-#else
-    size_t nb = (size_t)1;
-
-    /* HACK: add +1 to the realloc no. of bytes "just in case". */
-    /* XXX Likely unneeded, the issues wrto vsnprintf(3) return b0rkage have
-     * to do with whether the final '\0' is counted (or not). The code
-     * below already adds +1 for the (possibly already counted) trailing NUL.
-     */
-    while ((b = realloc(b, nb+1)) != NULL) {
+    (void) pthread_mutex_lock(&poptFprintfLock);
+    while (1) {
 	va_start(ap, format);
-	rc = vsnprintf(b, nb, format, ap);
+	rc = vsnprintf(st->b, st->nb, format, ap);
 	va_end(ap);
-	if (rc > -1) {	/* glibc 2.1 */
-	    if ((size_t)rc < nb)
-		break;
-	    nb = (size_t)(rc + 1);	/* precise buffer length known */
-	} else 		/* glibc 2.0 */
-	    nb += (nb < (size_t)100 ? (size_t)100 : nb);
-	ob = b;
+	if (rc < 0 || (size_t)rc < st->nb)
+	    break;
+	if (poptBufReserve(&st->b, &st->nb, (size_t)rc + 1)) {
+	    rc = -1;
+	    break;
+	}
     }
-#endif
 
-    rc = 0;
-    if (b != NULL) {
-#ifdef HAVE_ICONV
-	ob = strdup_locale_from_utf8(b);
-	if (ob != NULL) {
-	    rc = fprintf(stream, "%s", ob);
-	    free(ob);
-	} else
-#endif
-	    rc = fprintf(stream, "%s", b);
-	free (b);
-    }
+    if (rc > 0)
+	rc = poptWrite(st, st->b, (size_t)rc, stream);
+    (void) pthread_mutex_unlock(&poptFprintfLock);
+
+    return rc;
+}
 
+int
+POPT_fwrite (const char * b, size_t nb, FILE * stream)
+{
+    int rc = 0;
+
+    if (nb > 0) {
+	(void) pthread_mutex_lock(&poptFprintfLock);
+	rc = poptWrite(&poptFprintfState, b, nb, stream);
+	(void) pthread_mutex_unlock(&poptFprintfLock);
+    }
     return rc;
 }
 
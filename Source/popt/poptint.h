@@ -26,7 +26,7 @@ _free(/*@only@*/ /*@null@*/ const void * p)
 
 /* Bit mask macros. */
 /*@-exporttype -redef @*/
-typedef	unsigned int __pbm_bits;
+typedef	unsigned long long __pbm_bits;
 /*@=exporttype =redef @*/
 #define	__PBM_NBITS		(8 * sizeof (__pbm_bits))
 #define	__PBM_IX(d)		((d) / __PBM_NBITS)
@@ -38,16 +38,169 @@ typedef struct {
 /*@=exporttype =redef @*/
 #define	__PBM_BITS(set)	((set)->bits)
 
+/**
+ * Bit set header. The bits follow it in the same allocation, or, for a
+ * POPT_BITS_RDONLY set, are in a mapped bit set file (see below).
+ */
+struct poptBits_s {
+    unsigned int m;		/*!< no. of bits */
+    unsigned int k;		/*!< no. of hash probes per member */
+    unsigned int flags;		/*!< bit set layout (POPT_BITS_*), RDONLY if mapped */
+    unsigned int nw;		/*!< no. of words */
+/*@dependent@*/
+    __pbm_bits * bits;		/*!< the bits, 64 byte aligned when blocked */
+};
+
+/*
+ * Bit set files (poptBitsSave(), poptBitsLoad()): this header, then nw
+ * words.  The header is a whole cache line, so the words of a mapped file
+ * are as aligned as those of an allocated (blocked) set.
+ */
+#define	POPT_BITS_MAGIC		"POPTBITS"
+#define	POPT_BITS_VERSION	1U
+#define	POPT_BITS_ORDER		0x01020304U	/* in the saver's byte order */
+#define	POPT_BITS_HASH_JLU32	0U		/* jlu32lpair() */
+#define	POPT_BITS_HASH_XXH64	1U		/* xxh64pair() */
+
+struct poptBitsHeader_s {
+    char magic[8];		/*!< POPT_BITS_MAGIC, not NUL terminated */
+    uint32_t version;		/*!< POPT_BITS_VERSION */
+    uint32_t order;		/*!< POPT_BITS_ORDER */
+    uint32_t wordsize;		/*!< sizeof(__pbm_bits) */
+    uint32_t hash;		/*!< POPT_BITS_HASH_* */
+    uint32_t flags;		/*!< layout (POPT_BITS_BLOCKED|COUNTING) */
+    uint32_t k;			/*!< no. of hash probes per member */
+    uint32_t m;			/*!< no. of bits */
+    uint32_t nw;		/*!< no. of words */
+    uint32_t reserved[6];	/*!< zero */
+};
+
 #define	PBM_ALLOC(d)	calloc(__PBM_IX (d) + 1, sizeof(__pbm_bits))
 #define	PBM_FREE(s)	_free(s);
 #define PBM_SET(d, s)   (__PBM_BITS (s)[__PBM_IX (d)] |= __PBM_MASK (d))
 #define PBM_CLR(d, s)   (__PBM_BITS (s)[__PBM_IX (d)] &= ~__PBM_MASK (d))
 #define PBM_ISSET(d, s) ((__PBM_BITS (s)[__PBM_IX (d)] & __PBM_MASK (d)) != 0)
 
+/**
+ * Return index of lowest set bit in a (non-zero) bit mask word.
+ * @param w		bit mask word
+ * @return		bit index
+ */
+/*@unused@*/ static inline unsigned int
+__pbmCtz(__pbm_bits w)
+	/*@*/
+{
+#if defined(__GNUC__)
+    return (unsigned int) __builtin_ctzll(w);
+#else
+    unsigned int n = 0;
+    while (!(w & 1)) {
+	w >>= 1;
+	n++;
+    }
+    return n;
+#endif
+}
+
+/**
+ * Return the no. of set bits in a bit mask word.
+ * @param w		bit mask word
+ * @return		no. of set bits
+ */
+/*@unused@*/ static inline unsigned int
+__pbmPopcount(__pbm_bits w)
+	/*@*/
+{
+    /* Without a popcount insn, the builtin is a libgcc call: slower. */
+#if defined(__GNUC__) && (defined(__POPCNT__) || !(defined(__x86_64__) || defined(__i386__)))
+    return (unsigned int) __builtin_popcountll(w);
+#else
+    w = w - ((w >> 1) & 0x5555555555555555ULL);
+    w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+    w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (unsigned int) ((w * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+#if defined(__GNUC__)
+/* Word vectors for whole bit set operations, in the widest native width. */
+#if defined(__AVX512F__)
+#define	__PBM_VECW		8
+#elif defined(__AVX__)
+#define	__PBM_VECW		4
+#else
+#define	__PBM_VECW		2
+#endif
+/*@-exporttype@*/
+typedef __pbm_bits __pbm_vec
+	__attribute__((__vector_size__(__PBM_VECW * sizeof(__pbm_bits)),
+		__aligned__(sizeof(__pbm_bits)), __may_alias__));
+/*@=exporttype@*/
+#endif
+
+/**
+ * Find the first bit at or after d that is set (or clear), a word at a time.
+ * @param s		bit set, holding at least n bits
+ * @param d		first bit to examine
+ * @param n		no. of bits in set
+ * @param clr		look for a clear (rather than set) bit?
+ * @return		bit index, n if none
+ */
+/*@unused@*/ static inline unsigned int
+__pbmNext(const pbm_set * s, unsigned int d, unsigned int n, int clr)
+	/*@*/
+{
+    const __pbm_bits * bits = __PBM_BITS(s);
+    const __pbm_bits flip = (clr ? ~(__pbm_bits)0 : 0);
+    unsigned int ix;
+    __pbm_bits w;
+
+    if (d >= n)
+	return n;
+    ix = __PBM_IX(d);
+    w = (bits[ix] ^ flip) & (~(__pbm_bits)0 << (d % __PBM_NBITS));
+    while (w == 0) {
+	if (++ix > __PBM_IX(n - 1))
+	    return n;
+	w = bits[ix] ^ flip;
+    }
+    d = ix * __PBM_NBITS + __pbmCtz(w);
+    return (d < n ? d : n);
+}
+
+#define	PBM_NEXTSET(d, n, s)	__pbmNext((s), (d), (n), 0)
+#define	PBM_NEXTCLR(d, n, s)	__pbmNext((s), (d), (n), 1)
+
 extern void poptJlu32lpair(/*@null@*/ const void *key, size_t size,
                 uint32_t *pc, uint32_t *pb)
         /*@modifies *pc, *pb@*/;
 
+extern void poptJlu32lpairN(size_t n, const void * const *keys,
+                const size_t *sizes, uint32_t *pc, uint32_t *pb)
+        /*@modifies pc, pb@*/;
+
+extern void poptXxh64pair(/*@null@*/ const void *key, size_t size,
+                uint32_t *pc, uint32_t *pb)
+        /*@modifies *pc, *pb@*/;
+
+/**
+ * Split a string into tokens using poptParseArgvString() quoting rules.
+ * With buf == NULL, only count tokens and the bytes needed to store them.
+ * Otherwise tokens (NUL terminated) are written at buf, which may be s
+ * itself to split in place, and argv[0..argc-1] point at them.
+ * @param s		string to split
+ * @param buf		token storage (NULL to count)
+ * @param argv		token pointers (argc entries, unused when counting)
+ * @retval *argcPtr	no. of tokens
+ * @retval *nbPtr	no. of token bytes, including NUL terminators
+ * @return		0 on success, POPT_ERROR_BADQUOTE on dangling '\\'
+ */
+int poptArgvScan(const char * s, /*@null@*/ char * buf,
+		/*@null@*/ /*@out@*/ const char ** argv,
+		/*@null@*/ /*@out@*/ int * argcPtr,
+		/*@null@*/ /*@out@*/ size_t * nbPtr)
+	/*@modifies *buf, *argv, *argcPtr, *nbPtr @*/;
+
 /** \ingroup popt
  * Typedef's for string and array of strings.
  */
@@ -78,9 +231,9 @@ typedef union poptArg_u {
 
 /*@-exportvar@*/
 /*@unchecked@*/
-extern unsigned int _poptArgMask;
+extern const unsigned int _poptArgMask;
 /*@unchecked@*/
-extern unsigned int _poptGroupMask;
+extern const unsigned int _poptGroupMask;
 /*@=exportvar@*/
 
 #define	poptArgType(_opt)	((_opt)->argInfo & _poptArgMask)
@@ -92,14 +245,20 @@ extern unsigned int _poptGroupMask;
 
 /* XXX sick hack to preserve pretense of a popt-1.x ABI. */
 #define	poptSubstituteHelpI18N(opt) \
-  { /*@-observertrans@*/ \
-    if ((opt) == poptHelpOptions) (opt) = poptHelpOptionsI18N; \
-    /*@=observertrans@*/ }
+    ((opt) == poptHelpOptions ? poptHelpOptionsI18N : (opt))
 
+/**
+ * An option stack entry is a slice (argv, argc) of arguments still to be
+ * processed. The slice normally references storage owned elsewhere (the
+ * caller's argv, or an alias argv that lives as long as the context);
+ * argvbuf is non-NULL only when the entry had to build its own vector.
+ */
 struct optionStackEntry {
     int argc;
-/*@only@*/ /*@null@*/
+/*@dependent@*/ /*@null@*/
     poptArgv argv;
+/*@only@*/ /*@null@*/
+    poptArgv argvbuf;
 /*@only@*/ /*@null@*/
     pbm_set * argb;
     int next;
@@ -112,6 +271,73 @@ struct optionStackEntry {
     int stuffed;
 };
 
+/**
+ * Argument source of a poptGetStreamContext() context. The base option
+ * stack entry is a sliding window {argv0, previous, current} over the
+ * pulled args, with the two most recent held in recycled buffers.
+ */
+struct poptStream_s {
+    poptArgIterator next;
+/*@null@*/
+    void * data;
+/*@dependent@*/
+    const char * argv[4];
+/*@only@*/ /*@null@*/
+    char * argv0;
+/*@only@*/ /*@null@*/
+    char * buf[2];
+    size_t size[2];
+    int done;
+    int error;			/*!< POPT_ERROR_MALLOC once an arg is lost */
+};
+
+/**
+ * Length and capacity of a POPT_ARG_ARGV target vector being collected.
+ * The entry is trusted only while *argvp still equals argv, argv[argc]
+ * is NULL and argv[argc-1] is the last arg popt appended.
+ */
+struct poptArgvTarget_s {
+/*@shared@*/
+    const char *** argvp;
+/*@dependent@*/ /*@null@*/
+    const char ** argv;
+/*@dependent@*/ /*@null@*/
+    const char * last;		/* argv[argc-1] as last appended */
+    int argc;
+    int alloced;
+};
+
+/**
+ * Text of a "@file" response file, split in place into the args of an
+ * option stack entry. Leftover args point into it, so it is released when
+ * the context is reset rather than when the entry is popped.
+ */
+struct poptFileBuf_s {
+/*@only@*/
+    char * b;
+    size_t nmapped;		/* no. of bytes mapped, 0 if malloc'd */
+};
+
+/**
+ * Growable NUL terminated string.
+ */
+struct poptBuf_s {
+/*@only@*/ /*@null@*/
+    char * b;
+    size_t nb;			/* no. of bytes used */
+    size_t alloced;
+    int err;			/* malloc failed, further text is dropped */
+};
+
+/**
+ * Help and usage rendering buffers, kept by the context for reuse. All
+ * output is rendered into out and written at once, tmp is scratch.
+ */
+struct poptHelpBuf_s {
+    struct poptBuf_s out;
+    struct poptBuf_s tmp;
+};
+
 struct poptContext_s {
     struct optionStackEntry optionStack[POPT_OPTION_DEPTH];
 /*@dependent@*/
@@ -120,6 +346,7 @@ struct poptContext_s {
     poptArgv leftovers;
     int numLeftovers;
     int nextLeftover;
+    int leftoversAlloced;
 /*@keep@*/
     const struct poptOption * options;
     int restLeftover;
@@ -147,10 +374,23 @@ struct poptContext_s {
     const char * otherHelp;
 /*@null@*/
     pbm_set * arg_strip;
+/*@only@*/ /*@null@*/
+    struct poptArgvTarget_s * argvTargets;
+    int numArgvTargets;
+/*@only@*/ /*@null@*/
+    struct poptStream_s * stream;
+/*@only@*/ /*@null@*/
+    struct poptFileBuf_s * fileBufs;
+    int numFileBufs;
+    struct poptHelpBuf_s helpBuf;
+/*@dependent@*/ /*@null@*/
+    const struct poptPrerendered * prerendered;
 };
 
 #if defined(POPT_fprintf)
 #define	POPT_dgettext	dgettext
+#define	POPT_fwrite(_b, _nb, _stream) \
+    (fwrite((_b), 1, (_nb), (_stream)) == (_nb) ? (int)(_nb) : -1)
 #else
 #ifdef HAVE_ICONV
 #include <iconv.h>
@@ -183,13 +423,40 @@ extern char *nl_langinfo (nl_item __item)
 #endif
 
 #if defined(HAVE_DCGETTEXT) && !defined(__LCLINT__)
+/**
+ * Return the UTF-8 translation of a msgid, memoized per domain.
+ * @param dom		text domain (NULL uses textdomain(NULL))
+ * @param str		msgid
+ * @return		translation
+ */
 char *POPT_dgettext(const char * dom, const char * str)
 	/*@*/;
+
+/**
+ * Memoize the UTF-8 translations of several msgids at once, so that the
+ * domain codeset is rebound once rather than once per msgid.
+ * @param dom		text domain (NULL uses textdomain(NULL))
+ * @param strv		msgids (NULL entries are skipped)
+ * @param n		no. of msgids
+ */
+void POPT_dgettext_prime(const char * dom, const char * const * strv, size_t n)
+	/*@*/;
 #endif
 
 int   POPT_fprintf (FILE* stream, const char *format, ...)
 	/*@globals fileSystem @*/
 	/*@modifies stream, fileSystem @*/;
+
+/**
+ * Write UTF-8 text, converted to the locale codeset, in one go.
+ * @param b		text
+ * @param nb		no. of bytes
+ * @param stream	output file handle
+ * @return		no. of bytes written, -1 on error
+ */
+int   POPT_fwrite (const char * b, size_t nb, FILE * stream)
+	/*@globals fileSystem @*/
+	/*@modifies stream, fileSystem @*/;
 #endif	/* !defined(POPT_fprintf) */
 
 const char *POPT_prev_char (/*@returned@*/ const char *str)
@@ -7,8 +7,7 @@
    ftp://ftp.rpm.org/pub/rpm/dist. */
 
 #include "system.h"
-
-#define POPT_ARGV_ARRAY_GROW_DELTA 5
+#include "poptint.h"
 
 int poptDupArgv(int argc, const char **argv,
 		int * argcPtr, const char *** argvPtr)
@@ -51,76 +50,156 @@ int poptDupArgv(int argc, const char **argv,
     return 0;
 }
 
-int poptParseArgvString(const char * s, int * argcPtr, const char *** argvPtr)
+/* Word-at-a-time (SWAR) byte class tests, 8 bytes per step. */
+#define	_ARGV_ONES		((uint64_t)0x0101010101010101ULL)
+#define	_ARGV_HIGHS		(_ARGV_ONES * 0x80U)
+/* Non-zero iff some byte of _w is less than _n (_n <= 128). */
+#define	_ARGV_HASLESS(_w, _n)	(((_w) - _ARGV_ONES * (_n)) & ~(_w) & _ARGV_HIGHS)
+/* Non-zero iff some byte of _w equals _c. */
+#define	_ARGV_HASBYTE(_w, _c)	_ARGV_HASLESS((_w) ^ (_ARGV_ONES * (_c)), 1U)
+
+/**
+ * Return length of the leading run of bytes that need no special handling.
+ * Outside of quotes that excludes whitespace, control and non-ASCII bytes
+ * (isspace(3) is locale dependent); inside quotes only quotes and
+ * backslashes end the run.
+ * @param s		string
+ * @param se		end of string
+ * @param quoted	inside quotes?
+ * @return		no. of ordinary bytes at s
+ */
+static size_t argvSpan(const char * s, const char * se, int quoted)
+	/*@*/
+{
+    const char * t = s;
+
+    while ((size_t)(se - t) >= sizeof(uint64_t)) {
+	uint64_t w;
+	uint64_t x;
+
+	memcpy(&w, t, sizeof(w));
+	x = _ARGV_HASBYTE(w, '"') | _ARGV_HASBYTE(w, '\'') | _ARGV_HASBYTE(w, '\\');
+	if (!quoted)
+	    x |= _ARGV_HASLESS(w, 0x21U) | (w & _ARGV_HIGHS);
+	if (x)
+	    break;
+	t += sizeof(w);
+    }
+
+    for (; t < se; t++) {
+	unsigned char c = (unsigned char) *t;
+	if (c == '"' || c == '\'' || c == '\\')
+	    break;
+	if (!quoted && (c <= ' ' || c >= 0x80))
+	    break;
+    }
+    return (size_t)(t - s);
+}
+
+int poptArgvScan(const char * s, char * buf, const char ** argv,
+		int * argcPtr, size_t * nbPtr)
 {
-    const char * src;
+    const char * se = s + strlen(s);
+    char * te = buf;
     char quote = '\0';
-    int argvAlloced = POPT_ARGV_ARRAY_GROW_DELTA;
-    const char ** argv = malloc(sizeof(*argv) * argvAlloced);
+    size_t nb = 0;
+    size_t tn = 0;
     int argc = 0;
-    size_t buflen = strlen(s) + 1;
-    char * buf, * bufOrig = NULL;
-    int rc = POPT_ERROR_MALLOC;
 
-    if (argv == NULL) return rc;
-    buf = bufOrig = calloc((size_t)1, buflen);
-    if (buf == NULL) {
-	free(argv);
-	return rc;
+/* Append _n bytes at _p to the current token. */
+#define	ARGV_EMIT(_p, _n) \
+    {	if (te != NULL) { \
+	    if (tn == 0) argv[argc] = te; \
+	    memmove(te, (_p), (_n)); \
+	    te += (_n); \
+	} \
+	tn += (_n); \
+    }
+/* Terminate the current token (if any). */
+#define	ARGV_END() \
+    {	if (tn != 0) { \
+	    if (te != NULL) *te++ = '\0'; \
+	    nb += tn + 1; \
+	    tn = 0; \
+	    argc++; \
+	} \
     }
-    argv[argc] = buf;
 
-    for (src = s; *src != '\0'; src++) {
-	if (quote == *src) {
+    while (s < se) {
+	size_t n = argvSpan(s, se, (quote != '\0'));
+
+	if (n) {
+	    ARGV_EMIT(s, n);
+	    s += n;
+	    continue;
+	}
+
+	if (quote == *s) {
 	    quote = '\0';
 	} else if (quote != '\0') {
-	    if (*src == '\\') {
-		src++;
-		if (!*src) {
-		    rc = POPT_ERROR_BADQUOTE;
-		    goto exit;
-		}
-		if (*src != quote) *buf++ = '\\';
-	    }
-	    *buf++ = *src;
-	} else if (_isspaceptr(src)) {
-	    if (*argv[argc] != '\0') {
-		buf++, argc++;
-		if (argc == argvAlloced) {
-		    argvAlloced += POPT_ARGV_ARRAY_GROW_DELTA;
-		    argv = realloc(argv, sizeof(*argv) * argvAlloced);
-		    if (argv == NULL) goto exit;
-		}
-		argv[argc] = buf;
+	    if (*s == '\\') {
+		s++;
+		if (s == se)
+		    return POPT_ERROR_BADQUOTE;
+		if (*s != quote) ARGV_EMIT("\\", 1);
 	    }
-	} else switch (*src) {
+	    ARGV_EMIT(s, 1);
+	} else if (_isspaceptr(s)) {
+	    ARGV_END();
+	} else switch (*s) {
 	  case '"':
 	  case '\'':
-	    quote = *src;
+	    quote = *s;
 	    /*@switchbreak@*/ break;
 	  case '\\':
-	    src++;
-	    if (!*src) {
-		rc = POPT_ERROR_BADQUOTE;
-		goto exit;
-	    }
+	    s++;
+	    if (s == se)
+		return POPT_ERROR_BADQUOTE;
 	    /*@fallthrough@*/
 	  default:
-	    *buf++ = *src;
+	    ARGV_EMIT(s, 1);
 	    /*@switchbreak@*/ break;
 	}
+	s++;
     }
+    ARGV_END();
 
-    if (strlen(argv[argc])) {
-	argc++, buf++;
-    }
+#undef	ARGV_EMIT
+#undef	ARGV_END
+
+    if (argcPtr)
+	*argcPtr = argc;
+    if (nbPtr)
+	*nbPtr = nb;
+    return 0;
+}
+
+int poptParseArgvString(const char * s, int * argcPtr, const char *** argvPtr)
+{
+    const char ** argv;
+    int argc = 0;
+    size_t nb = 0;
+    int rc;
 
-    rc = poptDupArgv(argc, argv, argcPtr, argvPtr);
+    /* Count tokens and string bytes, then split into a single block. */
+    if ((rc = poptArgvScan(s, NULL, NULL, &argc, &nb)) != 0)
+	return rc;
+    if (argc <= 0)
+	return POPT_ERROR_NOARG;
+
+    argv = malloc((argc + 1) * sizeof(*argv) + nb);
+    if (argv == NULL)
+	return POPT_ERROR_MALLOC;
+    (void) poptArgvScan(s, (char *)(argv + argc + 1), argv, &argc, NULL);
+    argv[argc] = NULL;
 
-exit:
-    if (bufOrig) free(bufOrig);
-    if (argv) free(argv);
-    return rc;
+    if (argvPtr) {
+	*argvPtr = argv;
+    } else
+	free(argv);
+    if (argcPtr)
+	*argcPtr = argc;
+    return 0;
 }
 
 /* still in the dev stage.
@@ -0,0 +1,294 @@
+/* -------------------------------------------------------------------- */
+/*
+ * xxh64.c, the XXH64 hash of Yann Collet's xxHash, written from the
+ * algorithm description (xxhash_spec.md, BSD 2-Clause).
+ *
+ * XXH64 reads 32 bytes per round into 4 independent 64-bit lanes, so the
+ * rounds of a long key overlap in the pipeline, then folds 8, 4 and 1
+ * byte tails.  Keys are read with memcpy(), at any alignment and never
+ * past their end; byte order is decided at compile time.
+ *
+ * xxh64() returns the 64-bit hash.  xxh64pair() returns the low and high
+ * halves as two 32-bit hashes, a drop in for lookup3.c's jlu32lpair().
+ *
+ * Define _XXH64_SELFTEST to build a driver that checks known answers
+ * and times xxh64pair() against jlu32lpair() (cmake
+ * -DPOPT_BUILD_BENCHMARKS=ON builds it as xxh64-bench).
+ */
+/* -------------------------------------------------------------------- */
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(_XXH64_SELFTEST)
+# define _XXH64_xxh64		1
+# define _XXH64_xxh64pair	1
+#endif
+
+#define	_XXH64_P1	0x9E3779B185EBCA87ULL
+#define	_XXH64_P2	0xC2B2AE3D27D4EB4FULL
+#define	_XXH64_P3	0x165667B19E3779F9ULL
+#define	_XXH64_P4	0x85EBCA77C2B2AE63ULL
+#define	_XXH64_P5	0x27D4EB2F165667C5ULL
+
+#ifndef ROTL64
+# define ROTL64(x, s) (((x) << (s)) | ((x) >> (64 - (s))))
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+# define _XXH64_SWAP64(x)	__builtin_bswap64(x)
+# define _XXH64_SWAP32(x)	__builtin_bswap32(x)
+#else
+# define _XXH64_SWAP64(x)	(x)
+# define _XXH64_SWAP32(x)	(x)
+#endif
+
+/* Read 8 (4) key bytes as a little-endian integer. */
+static inline uint64_t _xxh64_read64(const uint8_t *p)
+	/*@*/
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return _XXH64_SWAP64(v);
+}
+
+static inline uint32_t _xxh64_read32(const uint8_t *p)
+	/*@*/
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return _XXH64_SWAP32(v);
+}
+
+static inline uint64_t _xxh64_round(uint64_t acc, uint64_t input)
+	/*@*/
+{
+    acc += input * _XXH64_P2;
+    acc = ROTL64(acc, 31);
+    return acc * _XXH64_P1;
+}
+
+static inline uint64_t _xxh64_merge(uint64_t h, uint64_t acc)
+	/*@*/
+{
+    h ^= _xxh64_round(0, acc);
+    return h * _XXH64_P1 + _XXH64_P4;
+}
+
+#if defined(_XXH64_xxh64) || defined(_XXH64_xxh64pair)
+/**
+ * Hash a variable-length key into a 64-bit value.
+ * @param seed		previous hash, or an arbitrary value
+ * @param key		the key (the unaligned variable-length array of bytes)
+ * @param size		the size of the key, counting the number of bytes
+ * @return		the 64-bit hash
+ */
+static uint64_t xxh64(uint64_t seed, /*@null@*/ const void *key, size_t size)
+	/*@*/
+{
+    const uint8_t *p = (const uint8_t *) (key != NULL ? key : "");
+    const uint8_t *pe;
+    uint64_t h;
+
+    if (key == NULL)
+	size = 0;
+    pe = p + size;
+
+    if (size >= 32) {
+	uint64_t v1 = seed + _XXH64_P1 + _XXH64_P2;
+	uint64_t v2 = seed + _XXH64_P2;
+	uint64_t v3 = seed;
+	uint64_t v4 = seed - _XXH64_P1;
+
+	/*------------------------------------------------- 32 bytes a round */
+	do {
+	    v1 = _xxh64_round(v1, _xxh64_read64(p));
+	    v2 = _xxh64_round(v2, _xxh64_read64(p + 8));
+	    v3 = _xxh64_round(v3, _xxh64_read64(p + 16));
+	    v4 = _xxh64_round(v4, _xxh64_read64(p + 24));
+	    p += 32;
+	} while (pe - p >= 32);
+
+	h = ROTL64(v1, 1) + ROTL64(v2, 7) + ROTL64(v3, 12) + ROTL64(v4, 18);
+	h = _xxh64_merge(h, v1);
+	h = _xxh64_merge(h, v2);
+	h = _xxh64_merge(h, v3);
+	h = _xxh64_merge(h, v4);
+    } else
+	h = seed + _XXH64_P5;
+
+    h += (uint64_t) size;
+
+    /*------------------------------------------------- the last 31 bytes */
+    for (; pe - p >= 8; p += 8) {
+	h ^= _xxh64_round(0, _xxh64_read64(p));
+	h = ROTL64(h, 27) * _XXH64_P1 + _XXH64_P4;
+    }
+    if (pe - p >= 4) {
+	h ^= (uint64_t) _xxh64_read32(p) * _XXH64_P1;
+	h = ROTL64(h, 23) * _XXH64_P2 + _XXH64_P3;
+	p += 4;
+    }
+    for (; p < pe; p++) {
+	h ^= (uint64_t) *p * _XXH64_P5;
+	h = ROTL64(h, 11) * _XXH64_P1;
+    }
+
+    /*------------------------------------------------------ avalanche */
+    h ^= h >> 33;
+    h *= _XXH64_P2;
+    h ^= h >> 29;
+    h *= _XXH64_P3;
+    h ^= h >> 32;
+    return h;
+}
+#endif	/* defined(_XXH64_xxh64) || defined(_XXH64_xxh64pair) */
+
+#if defined(_XXH64_xxh64pair)
+/**
+ * Hash a variable-length key into two 32-bit values, the low and high
+ * halves of its XXH64 hash.
+ * @param key		the key (the unaligned variable-length array of bytes)
+ * @param size		the size of the key, counting the number of bytes
+ * @retval *pc		IN: primary initval, OUT: primary hash
+ * @retval *pb		IN: secondary initval, OUT: secondary hash
+ */
+void xxh64pair(/*@null@*/ const void *key, size_t size,
+		uint32_t *pc, uint32_t *pb)
+	/*@modifies *pc, *pb @*/
+{
+    uint64_t h = xxh64(((uint64_t) *pb << 32) | *pc, key, size);
+
+    *pc = (uint32_t) h;
+    *pb = (uint32_t) (h >> 32);
+}
+#endif	/* defined(_XXH64_xxh64pair) */
+
+#if defined(_XXH64_SELFTEST)
+
+#include <stdio.h>
+#include <time.h>
+
+#define	_JLU3_jlu32lpair	1
+#include "lookup3.c"
+
+/* check known answers */
+static int driver1(void)
+	/*@*/
+{
+    static const struct {
+	const char *s;
+	uint64_t seed;
+	uint64_t h;
+    } kat[] = {
+	{ "",		0,	0xEF46DB3751D8E999ULL },
+	{ "a",		0,	0xD24EC4F1A98C6E5BULL },
+	{ "abc",	0,	0x44BC2CF5AD770999ULL },
+	{ "abc",	_XXH64_P1,	0xA7CB2AAC405E36C7ULL },
+	/* one 32 byte round, then with a 4 byte tail */
+	{ "abcdefghijklmnopqrstuvwxyz012345",	0,	0xBF2CD639B4143B80ULL },
+	{ "abcdefghijklmnopqrstuvwxyz0123456789", 0,	0x64F23ECF1609B766ULL },
+	{ "abcdefghijklmnopqrstuvwxyz0123456789", _XXH64_P1, 0x4F3C027835AB68F9ULL },
+    };
+    int rc = 0;
+    size_t i;
+
+    for (i = 0; i < sizeof(kat)/sizeof(kat[0]); i++) {
+	uint64_t h = xxh64(kat[i].seed, kat[i].s, strlen(kat[i].s));
+	if (h != kat[i].h) {
+	    printf("xxh64(\"%s\") = %016llx, expected %016llx\n", kat[i].s,
+		(unsigned long long) h, (unsigned long long) kat[i].h);
+	    rc++;
+	}
+    }
+    return rc;
+}
+
+/* check that alignment and trailing bytes don't change the hash */
+static int driver2(void)
+	/*@*/
+{
+    uint8_t buf[128 + 16];
+    uint8_t key[128];
+    size_t len, off;
+    int rc = 0;
+
+    for (len = 0; len < sizeof(key); len++)
+	key[len] = (uint8_t) (len * 37 + 11);
+    for (len = 0; len <= sizeof(key); len++) {
+	uint64_t ref = xxh64(1, key, len);
+	for (off = 1; off < 8; off++) {
+	    memset(buf, 0xff, sizeof(buf));
+	    memcpy(buf + off, key, len);
+	    if (xxh64(1, buf + off, len) != ref) {
+		printf("alignment error: len %d off %d\n", (int) len, (int) off);
+		rc++;
+	    }
+	}
+    }
+    return rc;
+}
+
+static double now(void)
+	/*@*/
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* time xxh64pair() against jlu32lpair() */
+static void driver3(const char *name, size_t len, size_t n)
+	/*@*/
+{
+    char key[1024];
+    uint32_t c = 0, b = 0, x = 0;
+    double t0, t1, t2;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+	key[i] = (char) ('a' + (i * 7) % 26);
+    t0 = now();
+    for (i = 0; i < n; i++) {
+	key[i % len] ^= 1;
+	jlu32lpair(key, len, &c, &b);
+	x += c ^ b;
+    }
+    t1 = now();
+    for (i = 0; i < n; i++) {
+	key[i % len] ^= 1;
+	xxh64pair(key, len, &c, &b);
+	x += c ^ b;
+    }
+    t2 = now();
+    printf("%-10s %4d bytes: jlu32lpair %6.1f ns  xxh64pair %6.1f ns  (%08x)\n",
+	name, (int) len, (t1 - t0) / n, (t2 - t1) / n, x);
+}
+
+/*
+ * usage: xxh64-bench [-c]
+ * Runs the checks, then (unless -c) the timings.  Exits non-zero if any
+ * check fails.
+ */
+int main(int argc, char ** argv)
+{
+    int rc = 0;
+
+    rc += driver1();	/* check known answers */
+    rc += driver2();	/* check alignment and trailing bytes */
+    if (rc)
+	printf("%d checks FAILED\n", rc);
+    else
+	printf("all checks passed\n");
+
+    if (!(argc > 1 && !strcmp(argv[1], "-c"))) {
+	driver3("option", 7, 10000000);	/* e.g. "verbose" */
+	driver3("option", 15, 10000000);
+	driver3("attribute", 64, 5000000);
+	driver3("attribute", 256, 2000000);
+	driver3("attribute", 1024, 500000);
+    }
+    return (rc ? 1 : 0);
+}
+
+#endif	/* _XXH64_SELFTEST */